@@ -0,0 +1,118 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+/*
+ * Compare the former replace-as-you-go formatting of notification
+ * messages with the precompiled format templates.
+ */
+#include <glib.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/format.h"
+#include "src/markup.h"
+#include "src/notification.h"
+#include "src/utils.h"
+
+/* the amount of body bytes formatted per measurement */
+#define WORKLOAD (4 * 1024 * 1024)
+
+static const char *format = "<b>%a</b> %p\\n<i>%s</i>\\n%b\\n%I";
+
+/* the formatting loop, as it was before format templates */
+static char *format_old(notification *n)
+{
+        char *msg = string_replace_all("\\n", "\n", g_strdup(format));
+
+        for(char *substr = strchr(msg, '%');
+                  substr;
+                  substr = strchr(substr, '%')) {
+
+                char pg[16];
+                char *icon_tmp;
+
+                switch(substr[1]) {
+                case 'a':
+                        notification_replace_single_field(&msg, &substr, n->appname, MARKUP_NO);
+                        break;
+                case 's':
+                        notification_replace_single_field(&msg, &substr, n->summary, n->markup);
+                        break;
+                case 'b':
+                        notification_replace_single_field(&msg, &substr, n->body, n->markup);
+                        break;
+                case 'I':
+                        icon_tmp = g_strdup(n->icon);
+                        notification_replace_single_field(&msg, &substr,
+                                icon_tmp ? basename(icon_tmp) : "", MARKUP_NO);
+                        g_free(icon_tmp);
+                        break;
+                case 'p':
+                        if (n->progress != -1)
+                                sprintf(pg, "[%3d%%]", n->progress);
+                        notification_replace_single_field(&msg, &substr,
+                                n->progress != -1 ? pg : "", MARKUP_NO);
+                        break;
+                default:
+                        substr++;
+                        break;
+                }
+        }
+
+        return msg;
+}
+
+static char *format_new(notification *n)
+{
+        return format_expand(format_compile(format), n);
+}
+
+static double bench(char *(*fn)(notification *), notification *n, char **result)
+{
+        int iterations = WORKLOAD / strlen(n->body);
+        gint64 start = g_get_monotonic_time();
+
+        for (int i = 0; i < iterations; i++) {
+                g_free(*result);
+                *result = fn(n);
+        }
+
+        return (double)(g_get_monotonic_time() - start) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+        notification *n = notification_create();
+        n->appname = g_strdup("bench");
+        n->summary = g_strdup("A summary with <b>markup</b> & entities");
+        n->icon = g_strdup("/usr/share/icons/bench.png");
+        n->markup = MARKUP_STRIP;
+        n->progress = 50;
+
+        printf("%10s %12s %12s\n", "body", "old (us)", "new (us)");
+
+        for (gsize len = 1024; len <= 64 * 1024; len *= 4) {
+                GString *body = g_string_sized_new(len);
+                while (body->len < len)
+                        g_string_append(body, "Some <i>long</i> body text<br>with a line break & more. ");
+                g_free(n->body);
+                n->body = g_string_free(body, false);
+
+                char *old = NULL, *new = NULL;
+                double t_old = bench(format_old, n, &old);
+                double t_new = bench(format_new, n, &new);
+
+                if (strcmp(old, new) != 0) {
+                        fprintf(stderr, "Results differ for a body of %zu bytes\n", len);
+                        return 1;
+                }
+                printf("%10zu %12.1f %12.1f\n", len, t_old, t_new);
+
+                g_free(old);
+                g_free(new);
+        }
+
+        notification_free(n);
+        format_teardown();
+        return 0;
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
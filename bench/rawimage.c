@@ -0,0 +1,85 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+/*
+ * Measure converting raw icons to premultiplied ARGB32 at common icon
+ * sizes, once as a plain conversion and once scaled down to 32 pixels,
+ * comparing the fused conversion with scaling the raw image first.
+ */
+#include <glib.h>
+#include <stdio.h>
+
+#include "src/rawimage.h"
+
+/* the amount of source pixels converted per measurement */
+#define WORKLOAD (16 * 1024 * 1024)
+#define ICON_SIZE 32
+
+static const int sizes[] = { 16, 22, 24, 32, 48, 64, 128, 256 };
+
+static RawImage *random_image(int size, bool alpha)
+{
+        RawImage *i = g_malloc(sizeof(RawImage));
+        int channels = alpha ? 4 : 3;
+
+        *i = (RawImage) { size, size, size * channels, alpha, 8, channels, NULL };
+        i->data = g_malloc(rawimage_data_size(i));
+        for (gsize b = 0; b < rawimage_data_size(i); b++)
+                i->data[b] = g_random_int_range(0, 256);
+
+        return i;
+}
+
+/* returns the time in ns per source pixel */
+static double bench_fused(const RawImage *i, int size, guint32 *argb)
+{
+        int width, height;
+        rawimage_scaled_size(i, size, &width, &height);
+
+        int iterations = WORKLOAD / (i->width * i->height);
+        gint64 start = g_get_monotonic_time();
+        for (int n = 0; n < iterations; n++)
+                rawimage_to_argb32(i, width, height, argb, width * 4);
+
+        return (g_get_monotonic_time() - start) * 1000.0 / WORKLOAD;
+}
+
+/* scale the raw image first and convert the result */
+static double bench_two_pass(const RawImage *i, int size, guint32 *argb)
+{
+        int iterations = WORKLOAD / (i->width * i->height);
+        gint64 start = g_get_monotonic_time();
+        for (int n = 0; n < iterations; n++) {
+                RawImage *s = rawimage_scale_down(i, size);
+                const RawImage *c = s ? s : i;
+                rawimage_to_argb32(c, c->width, c->height, argb, c->width * 4);
+                rawimage_free(s);
+        }
+
+        return (g_get_monotonic_time() - start) * 1000.0 / WORKLOAD;
+}
+
+int main(int argc, char *argv[])
+{
+        guint32 *argb = g_new(guint32, 256 * 256);
+
+        printf("ns per source pixel, scaled down to %d pixels\n", ICON_SIZE);
+        printf("%8s %6s %10s %10s %10s\n", "size", "alpha", "convert", "two pass", "fused");
+
+        for (int s = 0; s < G_N_ELEMENTS(sizes); s++) {
+                for (int alpha = 0; alpha <= 1; alpha++) {
+                        RawImage *i = random_image(sizes[s], alpha);
+
+                        double t_convert = bench_fused(i, 0, argb);
+                        double t_two_pass = bench_two_pass(i, ICON_SIZE, argb);
+                        double t_fused = bench_fused(i, ICON_SIZE, argb);
+
+                        printf("%4dx%-4d %6s %10.2f %10.2f %10.2f\n",
+                               sizes[s], sizes[s], alpha ? "yes" : "no",
+                               t_convert, t_two_pass, t_fused);
+                        rawimage_free(i);
+                }
+        }
+
+        g_free(argb);
+        return 0;
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
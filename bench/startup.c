@@ -0,0 +1,212 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+/*
+ * Measure loading a dunstrc with many rule sections and compare the
+ * former linear INI store with the hashed one.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/option_parser.h"
+#include "src/rules.h"
+#include "src/settings.h"
+
+#define SECTIONS 2000
+
+/* the keys load_settings looks up in every rule section */
+static const char *rule_keys[] = {
+        "appname", "summary", "body", "icon", "category", "appname_match",
+        "summary_match", "body_match", "icon_match", "category_match",
+        "timeout", "markup", "urgency", "msg_urgency", "foreground",
+        "background", "format", "new_icon", "history_ignore",
+        "match_transient", "set_transient", "script",
+};
+
+/* the INI store, as it was before it got hashed */
+typedef struct {
+        char *key;
+        char *value;
+} old_entry;
+
+typedef struct {
+        char *name;
+        int entry_count;
+        old_entry *entries;
+} old_section;
+
+static int old_section_count = 0;
+static old_section *old_sections = NULL;
+
+static old_section *old_get_section(const char *name)
+{
+        for (int i = 0; i < old_section_count; i++)
+                if (strcmp(old_sections[i].name, name) == 0)
+                        return &old_sections[i];
+        return NULL;
+}
+
+static void old_add_entry(const char *section, const char *key, const char *value)
+{
+        old_section *s = old_get_section(section);
+        if (!s) {
+                old_sections = g_realloc(old_sections, sizeof(old_section) * ++old_section_count);
+                s = &old_sections[old_section_count - 1];
+                s->name = g_strdup(section);
+                s->entry_count = 0;
+                s->entries = NULL;
+        }
+
+        s->entries = g_realloc(s->entries, sizeof(old_entry) * ++s->entry_count);
+        s->entries[s->entry_count - 1].key = g_strdup(key);
+        s->entries[s->entry_count - 1].value = g_strdup(value);
+}
+
+static const char *old_get_value(const char *section, const char *key)
+{
+        old_section *s = old_get_section(section);
+        if (!s)
+                return NULL;
+
+        for (int i = 0; i < s->entry_count; i++)
+                if (strcmp(s->entries[i].key, key) == 0)
+                        return s->entries[i].value;
+        return NULL;
+}
+
+static const char *old_next_section(const char *section)
+{
+        if (old_section_count == 0)
+                return NULL;
+        if (!section)
+                return old_sections[0].name;
+
+        for (int i = 0; i < old_section_count; i++)
+                if (strcmp(section, old_sections[i].name) == 0)
+                        return i + 1 < old_section_count ? old_sections[i + 1].name : NULL;
+        return NULL;
+}
+
+static void old_free(void)
+{
+        for (int i = 0; i < old_section_count; i++) {
+                for (int j = 0; j < old_sections[i].entry_count; j++) {
+                        g_free(old_sections[i].entries[j].key);
+                        g_free(old_sections[i].entries[j].value);
+                }
+                g_free(old_sections[i].entries);
+                g_free(old_sections[i].name);
+        }
+        g_free(old_sections);
+        old_sections = NULL;
+        old_section_count = 0;
+}
+
+/*
+ * Write a dunstrc with SECTIONS rules to path and fill the old store
+ * with the same entries.
+ */
+static void generate_dunstrc(const char *path)
+{
+        static const char *urgencies[] = { "low", "normal", "critical" };
+        GString *rc = g_string_new("[global]\n    font = Monospace 8\n    format = \"<b>%s</b>\\n%b\"\n");
+        char key[32], value[64];
+
+        old_add_entry("global", "font", "Monospace 8");
+        old_add_entry("global", "format", "<b>%s</b>\\n%b");
+
+        for (int i = 0; i < SECTIONS; i++) {
+                char section[32];
+                g_snprintf(section, sizeof(section), "rule-%d", i);
+                g_string_append_printf(rc, "\n[%s]\n", section);
+
+                const char *pairs[][2] = {
+                        { "appname", "app%d" },
+                        { "summary", "*summary %d*" },
+                        { "timeout", "%ds" },
+                        { "urgency", NULL },
+                };
+                for (int p = 0; p < G_N_ELEMENTS(pairs); p++) {
+                        g_strlcpy(key, pairs[p][0], sizeof(key));
+                        if (pairs[p][1])
+                                g_snprintf(value, sizeof(value), pairs[p][1], i);
+                        else
+                                g_strlcpy(value, urgencies[i % 3], sizeof(value));
+
+                        g_string_append_printf(rc, "    %s = \"%s\"\n", key, value);
+                        old_add_entry(section, key, value);
+                }
+        }
+
+        g_file_set_contents(path, rc->str, rc->len, NULL);
+        g_string_free(rc, true);
+}
+
+/* look up every rule key in every section, like load_settings does */
+static double bench_lookups(const char *(*next)(const char *),
+                            const char *(*get)(const char *, const char *),
+                            int *found)
+{
+        gint64 start = g_get_monotonic_time();
+
+        *found = 0;
+        for (const char *section = next(NULL); section; section = next(section))
+                for (int k = 0; k < G_N_ELEMENTS(rule_keys); k++)
+                        if (get(section, rule_keys[k]))
+                                (*found)++;
+
+        return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+/* the public store only hands out copies, so compare them by presence */
+static const char *new_get_value(const char *section, const char *key)
+{
+        return ini_is_set(section, key) ? key : NULL;
+}
+
+int main(int argc, char *argv[])
+{
+        char *dir = g_build_filename(g_get_tmp_dir(), "dunst-bench-XXXXXX", NULL);
+        if (!g_mkdtemp(dir)) {
+                fprintf(stderr, "Unable to create %s\n", dir);
+                return 1;
+        }
+        char *path = g_build_filename(dir, "dunstrc", NULL);
+        generate_dunstrc(path);
+
+        FILE *f = fopen(path, "r");
+        gint64 start = g_get_monotonic_time();
+        load_ini_file(f);
+        double t_parse = (g_get_monotonic_time() - start) / 1000.0;
+        fclose(f);
+
+        int found_old, found_new;
+        double t_old = bench_lookups(old_next_section, old_get_value, &found_old);
+        double t_new = bench_lookups(next_section, new_get_value, &found_new);
+        free_ini();
+        old_free();
+
+        if (found_old != found_new) {
+                fprintf(stderr, "Found %d values in the old store, but %d in the new one\n",
+                        found_old, found_new);
+                return 1;
+        }
+
+        start = g_get_monotonic_time();
+        load_settings(path);
+        double t_load = (g_get_monotonic_time() - start) / 1000.0;
+
+        printf("%d sections\n", SECTIONS);
+        printf("%-28s %10.1f ms\n", "parse", t_parse);
+        printf("%-28s %10.1f ms\n", "lookups, old store", t_old);
+        printf("%-28s %10.1f ms\n", "lookups, new store", t_new);
+        printf("%-28s %10.1f ms\n", "load_settings", t_load);
+
+        rules_teardown();
+        g_unlink(path);
+        g_rmdir(dir);
+        g_free(path);
+        g_free(dir);
+        return 0;
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -27,6 +27,9 @@ settings_t defaults = {
 .align = left,               /* text alignment [left/center/right] */
 .sticky_history = true,
 .history_length = 20,        /* max amount of notifications kept in history */
+.history_memory = 0,         /* max amount of memory in bytes used by history, 0 for no limit */
+.persistent_history = false, /* keep history in $XDG_DATA_HOME/dunst/history across restarts */
+.history_raw_icon = HISTORY_RAW_ICON_SCALE, /* scale raw icons in history down to max_icon_size */
 .show_indicators = true,
 .word_wrap = false,
 .ellipsize = middle,
@@ -58,6 +61,7 @@ settings_t defaults = {
 .browser = "/usr/bin/firefox",
 
 .max_icon_size = 0,
+.icon_cache_memory = 4194304, /* max amount of memory in bytes used by decoded icons, 0 to disable caching */
 
 /* paths to default icons */
 .icon_path = "/usr/share/icons/gnome/16x16/status/:/usr/share/icons/gnome/16x16/devices/",
@@ -109,6 +113,11 @@ rule_t default_rules[] = {
                 .icon            = NULL,
                 .category        = NULL,
                 .msg_urgency     = -1,
+                .appname_match   = MATCH_GLOB,
+                .summary_match   = MATCH_GLOB,
+                .body_match      = MATCH_GLOB,
+                .icon_match      = MATCH_GLOB,
+                .category_match  = MATCH_GLOB,
                 .timeout         = -1,
                 .urgency         = -1,
                 .markup          = MARKUP_NULL,
@@ -7,8 +7,10 @@
 #include <stdlib.h>
 
 #include "dunst.h"
+#include "icon_cache.h"
 #include "notification.h"
 #include "queues.h"
+#include "rules.h"
 #include "settings.h"
 #include "utils.h"
 
@@ -16,6 +18,8 @@
 #define FDN_IFAC "org.freedesktop.Notifications"
 #define FDN_NAME "org.freedesktop.Notifications"
 
+#define DUNST_IFAC "org.dunstproject.cmd0"
+
 GDBusConnection *dbus_conn;
 
 static GDBusNodeInfo *introspection_data = NULL;
@@ -62,6 +66,12 @@ static const char *introspection_xml =
     "            <arg name=\"action_key\" type=\"s\"/>"
     "        </signal>"
     "   </interface>"
+
+    "    <interface name=\""DUNST_IFAC"\">"
+    "        <method name=\"GetStats\">"
+    "            <arg direction=\"out\" name=\"stats\"           type=\"a{sv}\"/>"
+    "        </method>"
+    "   </interface>"
     "</node>";
 
 static void on_get_capabilities(GDBusConnection *connection,
@@ -80,7 +90,15 @@ static void on_get_server_information(GDBusConnection *connection,
                                       const gchar *sender,
                                       const GVariant *parameters,
                                       GDBusMethodInvocation *invocation);
+static void on_get_stats(GDBusConnection *connection,
+                         const gchar *sender,
+                         const GVariant *parameters,
+                         GDBusMethodInvocation *invocation);
 static RawImage *get_raw_image_from_data_hint(GVariant *icon_data);
+static RawImage *shrink_raw_icon(RawImage *raw_icon);
+
+/* bytes of raw icon data, which have been scaled away on arrival */
+static guint64 raw_icon_bytes_saved = 0;
 
 void handle_method_call(GDBusConnection *connection,
                         const gchar *sender,
@@ -99,6 +117,8 @@ void handle_method_call(GDBusConnection *connection,
                 on_close_notification(connection, sender, parameters, invocation);
         } else if (g_strcmp0(method_name, "GetServerInformation") == 0) {
                 on_get_server_information(connection, sender, parameters, invocation);
+        } else if (g_strcmp0(method_name, "GetStats") == 0) {
+                on_get_stats(connection, sender, parameters, invocation);
         } else {
                 fprintf(stderr, "WARNING: sender: %s; unknown method_name: %s\n", sender,
                        method_name);
@@ -272,7 +292,7 @@ static void on_notify(GDBusConnection *connection,
         n->summary = summary;
         n->body = body;
         n->icon = icon;
-        n->raw_icon = raw_icon;
+        n->raw_icon = rawimage_intern(shrink_raw_icon(raw_icon));
         n->timeout = timeout < 0 ? -1 : timeout * 1000;
         n->markup = settings.markup;
         n->progress = (progress < 0 || progress > 100) ? -1 : progress;
@@ -335,6 +355,46 @@ static void on_get_server_information(GDBusConnection *connection,
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
+static void on_get_stats(GDBusConnection *connection,
+                         const gchar *sender,
+                         const GVariant *parameters,
+                         GDBusMethodInvocation *invocation)
+{
+        GVariantBuilder *builder;
+        GVariant *value;
+
+        builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(builder, "{sv}", "history-length",
+                              g_variant_new_uint32(queues_length_history()));
+        g_variant_builder_add(builder, "{sv}", "history-bytes",
+                              g_variant_new_uint64(queues_history_size()));
+
+        guint64 hits, misses;
+        rules_cache_stats(&hits, &misses);
+        g_variant_builder_add(builder, "{sv}", "rule-cache-hits",
+                              g_variant_new_uint64(hits));
+        g_variant_builder_add(builder, "{sv}", "rule-cache-misses",
+                              g_variant_new_uint64(misses));
+
+        g_variant_builder_add(builder, "{sv}", "raw-icon-bytes-saved",
+                              g_variant_new_uint64(raw_icon_bytes_saved));
+
+        gsize icon_bytes;
+        icon_cache_stats(&hits, &misses, &icon_bytes);
+        g_variant_builder_add(builder, "{sv}", "icon-cache-hits",
+                              g_variant_new_uint64(hits));
+        g_variant_builder_add(builder, "{sv}", "icon-cache-misses",
+                              g_variant_new_uint64(misses));
+        g_variant_builder_add(builder, "{sv}", "icon-cache-bytes",
+                              g_variant_new_uint64(icon_bytes));
+
+        value = g_variant_new("(a{sv})", builder);
+        g_variant_builder_unref(builder);
+        g_dbus_method_invocation_return_value(invocation, value);
+
+        g_dbus_connection_flush(connection, NULL, NULL, NULL);
+}
+
 void signal_notification_closed(notification *n, enum reason reason)
 {
         if (reason < REASON_MIN || REASON_MAX < reason) {
@@ -409,6 +469,19 @@ static void on_bus_acquired(GDBusConnection *connection,
                 fprintf(stderr, "Unable to register dbus connection: %s\n", err->message);
                 exit(1);
         }
+
+        registration_id = g_dbus_connection_register_object(connection,
+                                                            FDN_PATH,
+                                                            introspection_data->interfaces[1],
+                                                            &interface_vtable,
+                                                            NULL,
+                                                            NULL,
+                                                            &err);
+
+        if (registration_id == 0) {
+                fprintf(stderr, "Unable to register dbus connection: %s\n", err->message);
+                exit(1);
+        }
 }
 
 static void on_name_acquired(GDBusConnection *connection,
@@ -432,7 +505,7 @@ static void on_name_lost(GDBusConnection *connection,
 
 static RawImage *get_raw_image_from_data_hint(GVariant *icon_data)
 {
-        RawImage *image = g_malloc(sizeof(RawImage));
+        RawImage *image = g_malloc0(sizeof(RawImage));
         GVariant *data_variant;
         gsize expected_len;
 
@@ -446,8 +519,18 @@ static RawImage *get_raw_image_from_data_hint(GVariant *icon_data)
                       &image->n_channels,
                       &data_variant);
 
-        expected_len = (image->height - 1) * image->rowstride + image->width
-                * ((image->n_channels * image->bits_per_sample + 7) / 8);
+        /* the spec only allows 8 bit RGB and RGBA data */
+        if (image->width <= 0 || image->height <= 0 || image->bits_per_sample != 8
+            || image->n_channels < 3 || image->n_channels > 4
+            || image->rowstride < (gint64) image->width * image->n_channels) {
+                fprintf(stderr, "Invalid image data of %dx%d pixels with a rowstride of %d\n",
+                        image->width, image->height, image->rowstride);
+                g_free(image);
+                g_variant_unref(data_variant);
+                return NULL;
+        }
+
+        expected_len = rawimage_data_size(image);
 
         if (expected_len != g_variant_get_size (data_variant)) {
                 fprintf(stderr, "Expected image data to be of length %" G_GSIZE_FORMAT
@@ -459,13 +542,36 @@ static RawImage *get_raw_image_from_data_hint(GVariant *icon_data)
                 return NULL;
         }
 
-        image->data = (guchar *) g_memdup(g_variant_get_data(data_variant),
-                                          g_variant_get_size(data_variant));
-        g_variant_unref(data_variant);
+        /* keep the message around instead of copying the pixels out of it,
+         * notification_compact copies them once n enters history */
+        image->data = (guchar *) g_variant_get_data(data_variant);
+        image->variant = data_variant;
 
         return image;
 }
 
+/*
+ * Scale raw_icon down to max_icon_size, as it is never drawn any larger,
+ * so that only the smaller copy is kept in the notification and history.
+ */
+static RawImage *shrink_raw_icon(RawImage *raw_icon)
+{
+        if (!raw_icon || settings.max_icon_size <= 0)
+                return raw_icon;
+
+        RawImage *scaled = rawimage_scale_down(raw_icon, settings.max_icon_size);
+        if (!scaled)
+                return raw_icon;
+
+        gsize size = rawimage_data_size(raw_icon);
+        gsize scaled_size = rawimage_data_size(scaled);
+        if (scaled_size < size)
+                raw_icon_bytes_saved += size - scaled_size;
+
+        rawimage_free(raw_icon);
+        return scaled;
+}
+
 int initdbus(void)
 {
         guint owner_id;
@@ -5,6 +5,7 @@
 #include "dunst.h"
 
 #include <X11/Xlib.h>
+#include <gio/gio.h>
 #include <glib-unix.h>
 #include <glib.h>
 #include <signal.h>
@@ -13,10 +14,13 @@
 #include <stdlib.h>
 
 #include "dbus.h"
+#include "format.h"
+#include "history_log.h"
 #include "menu.h"
 #include "notification.h"
 #include "option_parser.h"
 #include "queues.h"
+#include "rules.h"
 #include "settings.h"
 #include "x11/screen.h"
 #include "x11/x.h"
@@ -41,6 +45,16 @@ GMainLoop *mainloop = NULL;
 
 GSList *rules = NULL;
 
+static char *cmdline_config_path = NULL;
+
+/* watch on the loaded dunstrc and the pending reload it triggered */
+static GFileMonitor *config_monitor = NULL;
+static char *config_monitor_path = NULL;
+static guint config_reload_src = 0;
+
+/* time to wait for more changes to dunstrc, before reloading it */
+#define CONFIG_RELOAD_DELAY 100
+
 /* misc funtions */
 
 void wake_up(void)
@@ -111,11 +125,129 @@ gboolean quit_signal(gpointer data)
         return G_SOURCE_CONTINUE;
 }
 
+static void config_watch(void);
+
+/*
+ * Load dunstrc again and apply it to the running daemon. The queues
+ * and the history are kept.
+ *
+ * This only gets called from the main loop, so the new settings are
+ * swapped in between two runs of run().
+ */
+static void reload(void)
+{
+        gint64 start = g_get_monotonic_time();
+
+        if (cmdline_config_path && !g_file_test(cmdline_config_path, G_FILE_TEST_IS_REGULAR)) {
+                fprintf(stderr, "Cannot find config file: '%s', not reloading\n",
+                        cmdline_config_path);
+                return;
+        }
+
+        int sort = settings.sort;
+        enum icon_position_t icon_position = settings.icon_position;
+
+        /* release the shortcuts of the old settings */
+        if (xctx.visible)
+                x_win_hide();
+        x_shortcut_ungrab(&settings.history_ks);
+
+        load_settings(cmdline_config_path);
+        x_reload();
+
+        if (settings.sort != sort)
+                queues_resort();
+        if (settings.icon_position != icon_position)
+                queues_update_fingerprints();
+        queues_history_trim();
+
+        config_watch();
+
+        fprintf(stderr, "Reloaded configuration in %.1f ms\n",
+                (g_get_monotonic_time() - start) / 1000.0);
+
+        wake_up();
+}
+
+gboolean reload_signal(gpointer data)
+{
+        reload();
+
+        return G_SOURCE_CONTINUE;
+}
+
+static gboolean config_reload_timeout(gpointer data)
+{
+        config_reload_src = 0;
+        reload();
+
+        return G_SOURCE_REMOVE;
+}
+
+static void config_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+                           GFileMonitorEvent event, gpointer data)
+{
+        if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT
+            && event != G_FILE_MONITOR_EVENT_CREATED)
+                return;
+
+        /* editors write in several steps, so wait for them to finish */
+        if (!config_reload_src)
+                config_reload_src = g_timeout_add(CONFIG_RELOAD_DELAY, config_reload_timeout, NULL);
+}
+
+static void config_unwatch(void)
+{
+        if (config_reload_src) {
+                g_source_remove(config_reload_src);
+                config_reload_src = 0;
+        }
+        if (config_monitor) {
+                g_file_monitor_cancel(config_monitor);
+                g_object_unref(config_monitor);
+                config_monitor = NULL;
+        }
+        g_free(config_monitor_path);
+        config_monitor_path = NULL;
+}
+
+/*
+ * Watch the loaded dunstrc for changes, unless it is already watched.
+ */
+static void config_watch(void)
+{
+        const char *path = settings_config_path();
+
+        if (g_strcmp0(path, config_monitor_path) == 0)
+                return;
+
+        config_unwatch();
+        if (!path)
+                return;
+
+        GError *error = NULL;
+        GFile *file = g_file_new_for_path(path);
+        config_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+        g_object_unref(file);
+
+        if (!config_monitor) {
+                fprintf(stderr, "Unable to watch %s: %s\n", path, error->message);
+                g_error_free(error);
+                return;
+        }
+
+        config_monitor_path = g_strdup(path);
+        g_signal_connect(config_monitor, "changed", G_CALLBACK(config_changed), NULL);
+}
+
 static void teardown(void)
 {
-        regex_teardown();
+        config_unwatch();
 
+        history_log_close();
         teardown_queues();
+        format_teardown();
+        rules_teardown();
 
         x_free();
 }
@@ -132,7 +264,6 @@ int dunst_main(int argc, char *argv[])
                 print_version();
         }
 
-        char *cmdline_config_path;
         cmdline_config_path =
             cmdline_get_string("-conf/-config", NULL,
                                "Path to configuration file");
@@ -143,6 +274,15 @@ int dunst_main(int argc, char *argv[])
                 usage(EXIT_SUCCESS);
         }
 
+        if (settings.persistent_history) {
+                char *path = g_build_filename(g_get_user_data_dir(), "dunst", "history", NULL);
+                history_log_open(path, MAX(settings.history_length, 0));
+                g_free(path);
+
+                /* the replayed notifications count towards history_memory */
+                queues_history_trim();
+        }
+
         int owner_id = initdbus();
 
         x_setup();
@@ -192,6 +332,10 @@ int dunst_main(int argc, char *argv[])
         guint term_src = g_unix_signal_add(SIGTERM, quit_signal, NULL);
         guint int_src = g_unix_signal_add(SIGINT, quit_signal, NULL);
 
+        /* reload dunstrc on SIGHUP and whenever it changes */
+        guint hup_src = g_unix_signal_add(SIGHUP, reload_signal, NULL);
+        config_watch();
+
         run(NULL);
         g_main_loop_run(mainloop);
         g_main_loop_unref(mainloop);
@@ -201,6 +345,7 @@ int dunst_main(int argc, char *argv[])
         g_source_remove(unpause_src);
         g_source_remove(term_src);
         g_source_remove(int_src);
+        g_source_remove(hup_src);
 
         g_source_destroy(x11_source);
 
@@ -0,0 +1,197 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#include "format.h"
+
+#include <glib.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "markup.h"
+#include "notification.h"
+#include "utils.h"
+
+/* the format fields, which get replaced by notification content */
+#define FORMAT_FIELDS "asbIipn"
+
+typedef struct _format_op {
+        const char *literal;    /* points into format_template.text, NULL for a field */
+        gsize len;
+        char field;
+} format_op;
+
+struct _format_template {
+        char *text;             /* the format with escaped newlines replaced */
+        GArray *ops;
+};
+
+/* maps format strings to their format_template */
+static GHashTable *templates = NULL;
+
+static void format_template_free(gpointer data)
+{
+        format_template *t = data;
+
+        g_free(t->text);
+        g_array_free(t->ops, true);
+        g_free(t);
+}
+
+static void format_add_literal(format_template *t, const char *literal, gsize len)
+{
+        if (len == 0)
+                return;
+
+        format_op op = { literal, len, '\0' };
+        g_array_append_val(t->ops, op);
+}
+
+static void format_add_field(format_template *t, char field)
+{
+        format_op op = { NULL, 0, field };
+        g_array_append_val(t->ops, op);
+}
+
+static format_template *format_parse(const char *format)
+{
+        format_template *t = g_malloc(sizeof(format_template));
+        t->text = string_replace_all("\\n", "\n", g_strdup(format));
+        t->ops = g_array_new(false, false, sizeof(format_op));
+
+        const char *literal = t->text;
+        for (const char *substr = strchr(t->text, '%');
+                         substr;
+                         substr = strchr(substr, '%')) {
+
+                if (substr[1] != '\0' && strchr(FORMAT_FIELDS, substr[1])) {
+                        format_add_literal(t, literal, substr - literal);
+                        format_add_field(t, substr[1]);
+                        substr += 2;
+                        literal = substr;
+                } else if (substr[1] == '%') {
+                        /* keep one of both percent signs */
+                        format_add_literal(t, literal, substr + 1 - literal);
+                        substr += 2;
+                        literal = substr;
+                } else if (substr[1] == '\0') {
+                        fprintf(stderr, "WARNING: format_string has trailing %% character."
+                                        "To escape it use %%%%.\n");
+                        substr++;
+                } else {
+                        fprintf(stderr, "WARNING: format_string %%%c"
+                                        " is unknown\n", substr[1]);
+                        // keep the unknown field as it is
+                        substr++;
+                }
+        }
+        format_add_literal(t, literal, strlen(literal));
+
+        return t;
+}
+
+const format_template *format_compile(const char *format)
+{
+        if (!templates)
+                templates = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                  g_free, format_template_free);
+
+        format_template *t = g_hash_table_lookup(templates, format);
+        if (!t) {
+                t = format_parse(format);
+                g_hash_table_insert(templates, g_strdup(format), t);
+        }
+
+        return t;
+}
+
+/*
+ * Return the replacement for the given field, transformed
+ * according to the markup mode of the field.
+ */
+static char *format_field_value(const notification *n, char field)
+{
+        char pg[16] = "";
+        char *icon_tmp;
+        char *value;
+
+        switch (field) {
+        case 'a':
+                return markup_transform(g_strdup(n->appname ? n->appname : ""), MARKUP_NO);
+        case 's':
+                return markup_transform(g_strdup(n->summary ? n->summary : ""), n->markup);
+        case 'b':
+                return markup_transform(g_strdup(n->body ? n->body : ""), n->markup);
+        case 'I':
+                icon_tmp = g_strdup(n->icon);
+                value = g_strdup(icon_tmp ? basename(icon_tmp) : "");
+                g_free(icon_tmp);
+                return markup_transform(value, MARKUP_NO);
+        case 'i':
+                return markup_transform(g_strdup(n->icon ? n->icon : ""), MARKUP_NO);
+        case 'p':
+                if (n->progress != -1)
+                        sprintf(pg, "[%3d%%]", n->progress);
+                return markup_transform(g_strdup(pg), MARKUP_NO);
+        case 'n':
+                if (n->progress != -1)
+                        sprintf(pg, "%d", n->progress);
+                return markup_transform(g_strdup(pg), MARKUP_NO);
+        default:
+                return g_strdup("");
+        }
+}
+
+char *format_expand(const format_template *t, const notification *n)
+{
+        /* every field gets transformed once, no matter how often it's used */
+        char *values[sizeof(FORMAT_FIELDS)] = { NULL };
+        gsize lengths[sizeof(FORMAT_FIELDS)] = { 0 };
+        gsize size = 1;
+
+        for (guint i = 0; i < t->ops->len; i++) {
+                const format_op *op = &g_array_index(t->ops, format_op, i);
+
+                if (op->literal) {
+                        size += op->len;
+                        continue;
+                }
+
+                int field = strchr(FORMAT_FIELDS, op->field) - FORMAT_FIELDS;
+                if (!values[field]) {
+                        values[field] = format_field_value(n, op->field);
+                        lengths[field] = strlen(values[field]);
+                }
+                size += lengths[field];
+        }
+
+        char *msg = g_malloc(size);
+        char *pos = msg;
+
+        for (guint i = 0; i < t->ops->len; i++) {
+                const format_op *op = &g_array_index(t->ops, format_op, i);
+
+                if (op->literal) {
+                        memcpy(pos, op->literal, op->len);
+                        pos += op->len;
+                } else {
+                        int field = strchr(FORMAT_FIELDS, op->field) - FORMAT_FIELDS;
+                        memcpy(pos, values[field], lengths[field]);
+                        pos += lengths[field];
+                }
+        }
+        *pos = '\0';
+
+        for (int i = 0; i < sizeof(FORMAT_FIELDS); i++)
+                g_free(values[i]);
+
+        return msg;
+}
+
+void format_teardown(void)
+{
+        if (templates)
+                g_hash_table_destroy(templates);
+        templates = NULL;
+}
+
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
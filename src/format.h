@@ -0,0 +1,34 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#ifndef DUNST_FORMAT_H
+#define DUNST_FORMAT_H
+
+#include <glib.h>
+
+#include "notification.h"
+
+typedef struct _format_template format_template;
+
+/*
+ * Parse a format string like settings.format into a template.
+ * Templates are cached, so every distinct format string is only
+ * parsed once.
+ *
+ * Returns a template owned by the cache, which stays valid until
+ * format_teardown is called.
+ */
+const format_template *format_compile(const char *format);
+
+/*
+ * Expand the template with the fields of n in a single pass.
+ *
+ * Returns a newly allocated string.
+ */
+char *format_expand(const format_template *t, const notification *n);
+
+/*
+ * Free all cached templates.
+ */
+void format_teardown(void);
+
+#endif
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
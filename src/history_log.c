@@ -0,0 +1,701 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#include "history_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dunst.h"
+#include "notification.h"
+#include "settings.h"
+#include "x11/x.h"
+
+/*
+ * The log starts with HISTORY_LOG_MAGIC, followed by records.
+ * Every record is a native endian guint32 size, followed by size bytes
+ * of payload, whose first byte is the record_type. Integers are stored
+ * in native endianness and strings as a guint32 length (G_MAXUINT32
+ * for NULL) followed by the bytes of the string.
+ *
+ * Replaying the log treats it as a stack: every pop record cancels
+ * the newest push record before it and every drop record cancels the
+ * given amount of the oldest ones.
+ */
+#define HISTORY_LOG_MAGIC "DUNSTHL1"
+#define HISTORY_LOG_MAGIC_LEN 8
+
+enum record_type {
+        RECORD_PUSH = 1,
+        RECORD_POP = 2,
+        RECORD_DROP = 3,        /* followed by a guint32 count */
+};
+
+typedef struct _reader {
+        const guint8 *pos;
+        const guint8 *end;
+        bool error;
+} reader;
+
+static char *log_path = NULL;
+static int log_fd = -1;
+static GMappedFile *mapped = NULL;
+static GArray *pending = NULL;          /* offsets of the indexed records, oldest first */
+static gsize pending_size = 0;          /* the bytes of the indexed records */
+
+static GThread *writer = NULL;
+static GAsyncQueue *records = NULL;     /* GByteArrays waiting to be written */
+static GByteArray stop_record;          /* tells the writer to quit */
+
+/* only used by the writer, once it runs */
+static GArray *live = NULL;             /* offsets of the live records in the log, oldest first */
+static guint log_records = 0;           /* the amount of records in the log */
+
+/* rewrite the log, once it's mostly made up of dead records */
+#define HISTORY_LOG_WORTH_COMPACTING(records, live) ((records) > 2 * (live) + 64)
+
+static void put_data(GByteArray *b, const void *data, gsize len)
+{
+        g_byte_array_append(b, data, len);
+}
+
+static void put_uint8(GByteArray *b, guint8 v)
+{
+        put_data(b, &v, sizeof(v));
+}
+
+static void put_int32(GByteArray *b, gint32 v)
+{
+        put_data(b, &v, sizeof(v));
+}
+
+static void put_uint32(GByteArray *b, guint32 v)
+{
+        put_data(b, &v, sizeof(v));
+}
+
+static void put_int64(GByteArray *b, gint64 v)
+{
+        put_data(b, &v, sizeof(v));
+}
+
+static void put_string(GByteArray *b, const char *s)
+{
+        if (!s) {
+                put_uint32(b, G_MAXUINT32);
+                return;
+        }
+
+        guint32 len = strlen(s);
+        put_uint32(b, len);
+        put_data(b, s, len);
+}
+
+static void read_data(reader *r, void *dest, gsize len)
+{
+        if (r->error || (gsize) (r->end - r->pos) < len) {
+                r->error = true;
+                memset(dest, 0, len);
+                return;
+        }
+
+        memcpy(dest, r->pos, len);
+        r->pos += len;
+}
+
+static guint8 read_uint8(reader *r)
+{
+        guint8 v;
+        read_data(r, &v, sizeof(v));
+        return v;
+}
+
+static gint32 read_int32(reader *r)
+{
+        gint32 v;
+        read_data(r, &v, sizeof(v));
+        return v;
+}
+
+static guint32 read_uint32(reader *r)
+{
+        guint32 v;
+        read_data(r, &v, sizeof(v));
+        return v;
+}
+
+static gint64 read_int64(reader *r)
+{
+        gint64 v;
+        read_data(r, &v, sizeof(v));
+        return v;
+}
+
+static char *read_string(reader *r)
+{
+        guint32 len = read_uint32(r);
+
+        if (r->error || len == G_MAXUINT32)
+                return NULL;
+
+        if ((gsize) (r->end - r->pos) < len) {
+                r->error = true;
+                return NULL;
+        }
+
+        char *s = g_strndup((const char *) r->pos, len);
+        r->pos += len;
+        return s;
+}
+
+/*
+ * Start a record of the given type. Its size gets
+ * filled in by record_finish.
+ */
+static GByteArray *record_new(enum record_type type)
+{
+        GByteArray *b = g_byte_array_new();
+        put_uint32(b, 0);
+        put_uint8(b, type);
+        return b;
+}
+
+static GByteArray *record_finish(GByteArray *b)
+{
+        guint32 size = b->len - sizeof(guint32);
+        memcpy(b->data, &size, sizeof(size));
+        return b;
+}
+
+static GByteArray *history_log_encode(const notification *n)
+{
+        GByteArray *b = record_new(RECORD_PUSH);
+
+        /* the monotonic timestamp is meaningless after a restart */
+        put_int64(b, g_get_real_time() - (g_get_monotonic_time() - n->timestamp));
+        put_int64(b, n->timeout);
+        put_int64(b, n->fingerprint);
+        put_int32(b, n->urgency);
+        put_int32(b, n->markup);
+        put_int32(b, n->progress);
+        put_int32(b, n->dup_count);
+        put_uint8(b, n->transient);
+
+        put_string(b, n->appname);
+        put_string(b, n->summary);
+        put_string(b, n->body);
+        put_string(b, n->icon);
+        put_string(b, n->category);
+        put_string(b, n->link_urls);
+
+        put_uint8(b, n->raw_icon != NULL);
+        if (n->raw_icon) {
+                const RawImage *i = n->raw_icon;
+                gsize size = rawimage_data_size(i);
+
+                put_int32(b, i->width);
+                put_int32(b, i->height);
+                put_int32(b, i->rowstride);
+                put_int32(b, i->has_alpha);
+                put_int32(b, i->bits_per_sample);
+                put_int32(b, i->n_channels);
+                put_uint32(b, size);
+                put_data(b, i->data, size);
+        }
+
+        return record_finish(b);
+}
+
+static RawImage *history_log_decode_raw_icon(reader *r)
+{
+        RawImage *i = g_malloc0(sizeof(RawImage));
+
+        i->width = read_int32(r);
+        i->height = read_int32(r);
+        i->rowstride = read_int32(r);
+        i->has_alpha = read_int32(r);
+        i->bits_per_sample = read_int32(r);
+        i->n_channels = read_int32(r);
+        guint32 size = read_uint32(r);
+
+        if (r->error || i->width <= 0 || i->height <= 0 || i->rowstride <= 0
+            || i->n_channels <= 0 || i->bits_per_sample <= 0
+            || size != rawimage_data_size(i)) {
+                r->error = true;
+                g_free(i);
+                return NULL;
+        }
+
+        i->data = g_malloc(size);
+        read_data(r, i->data, size);
+        return i;
+}
+
+/* the size of the record at offset in the mapped log */
+static gsize history_log_record_size(gsize offset)
+{
+        guint32 size;
+        memcpy(&size, g_mapped_file_get_contents(mapped) + offset, sizeof(size));
+        return sizeof(size) + size;
+}
+
+static notification *history_log_decode(gsize offset)
+{
+        const guint8 *data = (const guint8 *) g_mapped_file_get_contents(mapped);
+        guint32 size;
+        memcpy(&size, data + offset, sizeof(size));
+
+        reader r = { data + offset + sizeof(size), data + offset + sizeof(size) + size, false };
+        if (read_uint8(&r) != RECORD_PUSH)
+                return NULL;
+
+        notification *n = notification_create();
+
+        gint64 real_time = read_int64(&r);
+        n->timestamp = g_get_monotonic_time() - (g_get_real_time() - real_time);
+        n->timeout = read_int64(&r);
+        n->fingerprint = read_int64(&r);
+        n->urgency = read_int32(&r);
+        n->markup = read_int32(&r);
+        n->progress = read_int32(&r);
+        n->dup_count = read_int32(&r);
+        n->transient = read_uint8(&r);
+
+        n->appname = read_string(&r);
+        n->summary = read_string(&r);
+        n->body = read_string(&r);
+        n->icon = read_string(&r);
+        n->category = read_string(&r);
+        n->link_urls = read_string(&r);
+
+        if (read_uint8(&r))
+                n->raw_icon = rawimage_intern(history_log_decode_raw_icon(&r));
+
+        if (r.error || !n->appname || !n->summary || !n->body
+            || n->urgency < URG_MIN || n->urgency > URG_MAX
+            || n->markup <= MARKUP_NULL || n->markup > MARKUP_FULL) {
+                fprintf(stderr, "WARNING: Skipping corrupt record in %s\n", log_path);
+                notification_free(n);
+                return NULL;
+        }
+
+        n->format = settings.format;
+        for (int i = 0; i < ColLast; i++)
+                n->color_strings[i] = xctx.color_strings[i][n->urgency];
+
+        return n;
+}
+
+static GByteArray *record_drop(guint32 count)
+{
+        GByteArray *b = record_new(RECORD_DROP);
+        put_uint32(b, count);
+        return record_finish(b);
+}
+
+/*
+ * Apply record, which is stored at offset in the log, to the offsets
+ * of the live records.
+ */
+static void history_log_replay(GArray *offsets, const guint8 *record, gsize offset)
+{
+        guint32 size, count;
+        memcpy(&size, record, sizeof(size));
+
+        switch (record[sizeof(size)]) {
+        case RECORD_PUSH:
+                g_array_append_val(offsets, offset);
+                break;
+        case RECORD_POP:
+                if (offsets->len > 0)
+                        g_array_set_size(offsets, offsets->len - 1);
+                break;
+        case RECORD_DROP:
+                if (size < 1 + sizeof(count))
+                        break;
+                memcpy(&count, record + sizeof(size) + 1, sizeof(count));
+                g_array_remove_range(offsets, 0, MIN(count, offsets->len));
+                break;
+        }
+}
+
+static bool write_all(int fd, const void *data, gsize len)
+{
+        const char *pos = data;
+
+        while (len > 0) {
+                ssize_t written = write(fd, pos, len);
+                if (written < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+                pos += written;
+                len -= written;
+        }
+
+        return true;
+}
+
+static bool history_log_map(void)
+{
+        GError *err = NULL;
+
+        if (mapped)
+                g_mapped_file_unref(mapped);
+
+        mapped = g_mapped_file_new(log_path, false, &err);
+        if (!mapped) {
+                fprintf(stderr, "WARNING: Unable to map %s: %s\n", log_path, err->message);
+                g_error_free(err);
+                return false;
+        }
+
+        return true;
+}
+
+/*
+ * Replace the log with one containing only the records at offsets
+ * in data.
+ *
+ * Returns the offsets of the records in the new log or NULL, if the
+ * old log is still in place.
+ */
+static GArray *history_log_compact(const char *data, const GArray *offsets)
+{
+        char *tmp_path = g_strconcat(log_path, ".tmp", NULL);
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        bool ok = fd >= 0;
+
+        GArray *compacted = g_array_sized_new(false, false, sizeof(gsize), offsets->len);
+        gsize offset = HISTORY_LOG_MAGIC_LEN;
+        ok = ok && write_all(fd, HISTORY_LOG_MAGIC, HISTORY_LOG_MAGIC_LEN);
+        for (guint i = 0; ok && i < offsets->len; i++) {
+                gsize record = g_array_index(offsets, gsize, i);
+                guint32 size;
+                memcpy(&size, data + record, sizeof(size));
+
+                ok = write_all(fd, data + record, sizeof(size) + size);
+                g_array_append_val(compacted, offset);
+                offset += sizeof(size) + size;
+        }
+        ok = ok && fsync(fd) == 0;
+
+        if (fd >= 0)
+                close(fd);
+
+        ok = ok && g_rename(tmp_path, log_path) == 0;
+        if (!ok) {
+                fprintf(stderr, "WARNING: Unable to compact %s: %s\n", log_path, strerror(errno));
+                g_unlink(tmp_path);
+                g_array_free(compacted, true);
+                compacted = NULL;
+        }
+        g_free(tmp_path);
+
+        return compacted;
+}
+
+/*
+ * Compact the log from the writer to the live records and continue
+ * writing at the end of the new log.
+ *
+ * Returns false, if the log can't be written to anymore.
+ */
+static bool history_log_compact_live(off_t *end)
+{
+        GError *err = NULL;
+        GMappedFile *current = g_mapped_file_new(log_path, false, &err);
+        if (!current) {
+                fprintf(stderr, "WARNING: Unable to map %s: %s\n", log_path, err->message);
+                g_error_free(err);
+                return true;
+        }
+
+        GArray *compacted = history_log_compact(g_mapped_file_get_contents(current), live);
+        g_mapped_file_unref(current);
+        if (!compacted)
+                return true;
+
+        g_array_free(live, true);
+        live = compacted;
+        log_records = live->len;
+
+        close(log_fd);
+        log_fd = open(log_path, O_RDWR | O_APPEND);
+        struct stat st;
+        if (log_fd < 0 || fstat(log_fd, &st) != 0) {
+                fprintf(stderr, "WARNING: Unable to reopen %s, "
+                                "not keeping history in it anymore: %s\n",
+                                log_path, strerror(errno));
+                return false;
+        }
+        *end = st.st_size;
+
+        return true;
+}
+
+/*
+ * Write all queued records in batches and sync
+ * each batch to disk at once.
+ *
+ * After a failed write, the partial record is cut off again and no
+ * further records are written, as every record after a missing one
+ * would be replayed against the wrong notifications.
+ *
+ * The writer keeps track of the live records and compacts the log,
+ * once most of its records are dead.
+ */
+static gpointer history_log_write(gpointer data)
+{
+        bool failed = false;
+        struct stat st;
+        off_t end = fstat(log_fd, &st) == 0 ? st.st_size : 0;
+
+        for (;;) {
+                GByteArray *record = g_async_queue_pop(records);
+                bool stop = false;
+
+                do {
+                        if (record == &stop_record) {
+                                stop = true;
+                                break;
+                        }
+
+                        if (!failed && !write_all(log_fd, record->data, record->len)) {
+                                fprintf(stderr, "WARNING: Unable to write to %s, "
+                                                "not keeping history in it anymore: %s\n",
+                                                log_path, strerror(errno));
+                                failed = true;
+                                if (ftruncate(log_fd, end) != 0)
+                                        fprintf(stderr, "WARNING: Unable to truncate %s: %s\n",
+                                                        log_path, strerror(errno));
+                        } else if (!failed) {
+                                history_log_replay(live, record->data, end);
+                                log_records++;
+                                end += record->len;
+                        }
+                        g_byte_array_unref(record);
+                } while ((record = g_async_queue_try_pop(records)));
+
+                fsync(log_fd);
+
+                if (!failed && HISTORY_LOG_WORTH_COMPACTING(log_records, live->len))
+                        failed = !history_log_compact_live(&end);
+
+                if (stop)
+                        return NULL;
+        }
+}
+
+bool history_log_open(const char *path, unsigned int max)
+{
+        if (records)
+                return true;
+
+        char *dir = g_path_get_dirname(path);
+        g_mkdir_with_parents(dir, 0700);
+        g_free(dir);
+
+        log_path = g_strdup(path);
+        log_fd = open(log_path, O_RDWR | O_CREAT | O_APPEND, 0600);
+        if (log_fd < 0) {
+                fprintf(stderr, "WARNING: Unable to open %s: %s\n", log_path, strerror(errno));
+                goto fail;
+        }
+
+        struct stat st;
+        if (fstat(log_fd, &st) == 0 && st.st_size == 0)
+                write_all(log_fd, HISTORY_LOG_MAGIC, HISTORY_LOG_MAGIC_LEN);
+
+        if (!history_log_map())
+                goto fail;
+
+        const char *data = g_mapped_file_get_contents(mapped);
+        gsize len = g_mapped_file_get_length(mapped);
+
+        if (len < HISTORY_LOG_MAGIC_LEN
+            || memcmp(data, HISTORY_LOG_MAGIC, HISTORY_LOG_MAGIC_LEN) != 0) {
+                fprintf(stderr, "WARNING: %s is not a dunst history log\n", log_path);
+                goto fail;
+        }
+
+        /* only read the record sizes and stop at a truncated record */
+        GArray *all = g_array_new(false, false, sizeof(gsize));
+        gsize offset = HISTORY_LOG_MAGIC_LEN;
+        while (len - offset >= sizeof(guint32)) {
+                guint32 size;
+                memcpy(&size, data + offset, sizeof(size));
+                if (size == 0 || len - offset - sizeof(size) < size)
+                        break;
+
+                g_array_append_val(all, offset);
+                offset += sizeof(size) + size;
+        }
+
+        /* drop the partial record of an interrupted write */
+        if (offset < len && ftruncate(log_fd, offset) != 0)
+                fprintf(stderr, "WARNING: Unable to truncate %s: %s\n", log_path, strerror(errno));
+
+        live = g_array_new(false, false, sizeof(gsize));
+        for (guint i = 0; i < all->len; i++) {
+                gsize record = g_array_index(all, gsize, i);
+                history_log_replay(live, (const guint8 *) data + record, record);
+        }
+        log_records = all->len;
+        g_array_free(all, true);
+
+        /* only index the newest notifications and drop the others for good */
+        guint dropped = max > 0 && live->len > max ? live->len - max : 0;
+        pending = g_array_sized_new(false, false, sizeof(gsize), live->len - dropped);
+        g_array_append_vals(pending, &g_array_index(live, gsize, dropped), live->len - dropped);
+
+        /* keep the log from growing without bounds */
+        GArray *compacted = NULL;
+        if (HISTORY_LOG_WORTH_COMPACTING(log_records, pending->len))
+                compacted = history_log_compact(data, pending);
+        if (compacted) {
+                g_array_free(pending, true);
+                pending = compacted;
+                g_array_free(live, true);
+                g_array_set_size(live, 0);
+                g_array_append_vals(live, pending->data, pending->len);
+                log_records = live->len;
+                dropped = 0;
+
+                close(log_fd);
+                log_fd = open(log_path, O_RDWR | O_APPEND);
+                if (log_fd < 0 || !history_log_map()) {
+                        fprintf(stderr, "WARNING: Unable to reopen %s: %s\n", log_path, strerror(errno));
+                        goto fail;
+                }
+        }
+
+        pending_size = 0;
+        for (guint i = 0; i < pending->len; i++)
+                pending_size += history_log_record_size(g_array_index(pending, gsize, i));
+
+        records = g_async_queue_new();
+        if (dropped > 0)
+                g_async_queue_push(records, record_drop(dropped));
+        writer = g_thread_new("history-log", history_log_write, NULL);
+
+        return true;
+
+fail:
+        if (log_fd >= 0)
+                close(log_fd);
+        log_fd = -1;
+        if (mapped)
+                g_mapped_file_unref(mapped);
+        mapped = NULL;
+        if (pending)
+                g_array_free(pending, true);
+        pending = NULL;
+        if (live)
+                g_array_free(live, true);
+        live = NULL;
+        g_free(log_path);
+        log_path = NULL;
+
+        return false;
+}
+
+void history_log_close(void)
+{
+        if (!records)
+                return;
+
+        g_async_queue_push(records, &stop_record);
+        g_thread_join(writer);
+        writer = NULL;
+        g_async_queue_unref(records);
+        records = NULL;
+
+        close(log_fd);
+        log_fd = -1;
+        g_mapped_file_unref(mapped);
+        mapped = NULL;
+        g_array_free(pending, true);
+        pending = NULL;
+        pending_size = 0;
+        g_array_free(live, true);
+        live = NULL;
+        g_free(log_path);
+        log_path = NULL;
+}
+
+void history_log_push(const notification *n)
+{
+        if (records)
+                g_async_queue_push(records, history_log_encode(n));
+}
+
+void history_log_pop(void)
+{
+        if (records)
+                g_async_queue_push(records, record_finish(record_new(RECORD_POP)));
+}
+
+unsigned int history_log_length(void)
+{
+        return pending ? pending->len : 0;
+}
+
+void history_log_trim(unsigned int max)
+{
+        if (pending && pending->len > max)
+                history_log_drop(pending->len - max);
+}
+
+void history_log_trim_size(gsize size)
+{
+        unsigned int count = 0;
+        gsize trimmed = pending_size;
+
+        while (count < history_log_length() && trimmed > size)
+                trimmed -= history_log_record_size(g_array_index(pending, gsize, count++));
+
+        history_log_drop(count);
+}
+
+gsize history_log_size(void)
+{
+        return pending_size;
+}
+
+void history_log_drop(unsigned int count)
+{
+        if (!records || count == 0)
+                return;
+
+        guint indexed = MIN(count, pending->len);
+        for (guint i = 0; i < indexed; i++)
+                pending_size -= history_log_record_size(g_array_index(pending, gsize, i));
+        g_array_remove_range(pending, 0, indexed);
+        g_async_queue_push(records, record_drop(count));
+}
+
+notification *history_log_take(void)
+{
+        notification *n = NULL;
+
+        while (!n && pending && pending->len > 0) {
+                gsize record = g_array_index(pending, gsize, pending->len - 1);
+                g_array_set_size(pending, pending->len - 1);
+                pending_size -= history_log_record_size(record);
+                n = history_log_decode(record);
+
+                /* the caller only pops the one it got */
+                if (!n)
+                        history_log_pop();
+        }
+
+        return n;
+}
+
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,72 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#ifndef DUNST_HISTORY_LOG_H
+#define DUNST_HISTORY_LOG_H
+
+#include <stdbool.h>
+
+#include "notification.h"
+
+/*
+ * Open the history log at path, creating it if necessary, and index
+ * the newest max notifications in it (all of them if max is 0).
+ * The indexed notifications are only decoded by history_log_take.
+ *
+ * Returns false, if the log could not be opened. All other
+ * history_log functions are no-ops until it has been opened.
+ */
+bool history_log_open(const char *path, unsigned int max);
+
+/*
+ * Write out all pending records and close the log.
+ */
+void history_log_close(void);
+
+/*
+ * Append n to the log. The record is written and synced to disk
+ * in the background.
+ */
+void history_log_push(const notification *n);
+
+/*
+ * Record that the newest notification in history has been popped.
+ */
+void history_log_pop(void);
+
+/*
+ * Returns the amount of indexed notifications, which have not been
+ * taken yet.
+ */
+unsigned int history_log_length(void);
+
+/*
+ * Drop the oldest indexed notifications until only max are left.
+ */
+void history_log_trim(unsigned int max);
+
+/*
+ * Returns the size in bytes of the indexed notifications' records.
+ */
+gsize history_log_size(void);
+
+/*
+ * Drop the oldest indexed notifications until their records take at
+ * most size bytes.
+ */
+void history_log_trim_size(gsize size);
+
+/*
+ * Record that the oldest count notifications in history have been
+ * dropped, starting with the indexed ones, which are older than the
+ * ones pushed since opening the log.
+ */
+void history_log_drop(unsigned int count);
+
+/*
+ * Decode and remove the newest indexed notification.
+ *
+ * Returns the notification or NULL, if there is none left.
+ */
+notification *history_log_take(void);
+
+#endif
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,120 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#include "icon_cache.h"
+
+#include <glib.h>
+
+typedef struct _icon_entry {
+        char *key;
+        gpointer icon;
+        gsize bytes;
+        GDestroyNotify free_func;
+        GList link;             /* in lru, the most recently used first */
+} icon_entry;
+
+/* "size:path" -> icon_entry */
+static GHashTable *icons = NULL;
+static GQueue lru = G_QUEUE_INIT;
+static gsize used = 0;
+static gsize limit = 0;
+
+static guint64 hits = 0;
+static guint64 misses = 0;
+
+static char *icon_key(const char *path, int size)
+{
+        return g_strdup_printf("%d:%s", size, path);
+}
+
+static void icon_entry_free(gpointer data)
+{
+        icon_entry *e = data;
+
+        g_queue_unlink(&lru, &e->link);
+        used -= e->bytes;
+
+        if (e->free_func)
+                e->free_func(e->icon);
+        g_free(e->key);
+        g_free(e);
+}
+
+static void icon_cache_evict(void)
+{
+        while (used > limit && lru.tail) {
+                icon_entry *e = lru.tail->data;
+                g_hash_table_remove(icons, e->key);
+        }
+}
+
+gpointer icon_cache_lookup(const char *path, int size)
+{
+        if (!icons) {
+                misses++;
+                return NULL;
+        }
+
+        char *key = icon_key(path, size);
+        icon_entry *e = g_hash_table_lookup(icons, key);
+        g_free(key);
+
+        if (!e) {
+                misses++;
+                return NULL;
+        }
+
+        hits++;
+        g_queue_unlink(&lru, &e->link);
+        g_queue_push_head_link(&lru, &e->link);
+        return e->icon;
+}
+
+void icon_cache_insert(const char *path, int size, gpointer icon,
+                       gsize bytes, GDestroyNotify free_func)
+{
+        if (bytes > limit) {
+                if (free_func)
+                        free_func(icon);
+                return;
+        }
+
+        if (!icons)
+                icons = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              NULL, icon_entry_free);
+
+        icon_entry *e = g_malloc(sizeof(icon_entry));
+        e->key = icon_key(path, size);
+        e->icon = icon;
+        e->bytes = bytes;
+        e->free_func = free_func;
+        e->link = (GList) { e, NULL, NULL };
+
+        /* frees an entry with the same key */
+        g_hash_table_replace(icons, e->key, e);
+        g_queue_push_head_link(&lru, &e->link);
+        used += bytes;
+
+        icon_cache_evict();
+}
+
+void icon_cache_set_limit(gsize bytes)
+{
+        limit = bytes;
+        if (icons)
+                icon_cache_evict();
+}
+
+void icon_cache_stats(guint64 *h, guint64 *m, gsize *bytes)
+{
+        *h = hits;
+        *m = misses;
+        *bytes = used;
+}
+
+void icon_cache_clear(void)
+{
+        if (icons) {
+                g_hash_table_destroy(icons);
+                icons = NULL;
+        }
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
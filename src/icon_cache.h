@@ -0,0 +1,45 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#ifndef DUNST_ICON_CACHE_H
+#define DUNST_ICON_CACHE_H
+
+#include <glib.h>
+
+/*
+ * A least recently used cache of decoded icons, keyed by their path
+ * and the size they have been scaled to. The icons are opaque to the
+ * cache, it only keeps track of their size in bytes.
+ */
+
+/*
+ * Look up the icon loaded from path and scaled to size.
+ *
+ * Returns the icon, which stays owned by the cache, or NULL.
+ */
+gpointer icon_cache_lookup(const char *path, int size);
+
+/*
+ * Add an icon to the cache, which takes over the icon and frees it
+ * with free_func, once it gets evicted. An icon, which is larger than
+ * the whole cache, gets freed right away.
+ */
+void icon_cache_insert(const char *path, int size, gpointer icon,
+                       gsize bytes, GDestroyNotify free_func);
+
+/*
+ * Set the amount of bytes the cached icons may use and evict the least
+ * recently used ones, until they fit. A limit of 0 disables the cache.
+ */
+void icon_cache_set_limit(gsize bytes);
+
+/*
+ * Get the hit and miss counts of the cache and the bytes it uses.
+ */
+void icon_cache_stats(guint64 *hits, guint64 *misses, gsize *bytes);
+
+/*
+ * Free all cached icons.
+ */
+void icon_cache_clear(void);
+
+#endif
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
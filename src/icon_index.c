@@ -0,0 +1,228 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#include "icon_index.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "icon_cache.h"
+
+static char *indexed_path = NULL;
+static char **folders = NULL;
+/* icon name -> GPtrArray of the paths of its files, best one first */
+static GHashTable *icons = NULL;
+static GPtrArray *monitors = NULL;
+static bool stale = false;
+
+static const char *extensions[] = { ".svg", ".png" };
+
+/*
+ * Add the icons with the given extension in folder behind the ones of
+ * previous folders and extensions.
+ */
+static void icon_index_add(const char *folder, GPtrArray *files, const char *ext)
+{
+        for (guint i = 0; i < files->len; i++) {
+                const char *file = files->pdata[i];
+                if (!g_str_has_suffix(file, ext))
+                        continue;
+
+                char *name = g_strndup(file, strlen(file) - strlen(ext));
+                if (!*name) {
+                        g_free(name);
+                        continue;
+                }
+
+                char *path = g_build_filename(folder, file, NULL);
+                if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+                        g_free(name);
+                        g_free(path);
+                        continue;
+                }
+
+                GPtrArray *paths = g_hash_table_lookup(icons, name);
+                if (paths) {
+                        g_free(name);
+                } else {
+                        paths = g_ptr_array_new_with_free_func(g_free);
+                        g_hash_table_insert(icons, name, paths);
+                }
+                g_ptr_array_add(paths, path);
+        }
+}
+
+static void paths_free(gpointer data)
+{
+        g_ptr_array_free(data, true);
+}
+
+static void icon_index_scan(void)
+{
+        if (icons)
+                g_hash_table_remove_all(icons);
+        else
+                icons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, paths_free);
+
+        for (char **folder = folders; folder && *folder; folder++) {
+                GDir *dir = g_dir_open(*folder, 0, NULL);
+                if (!dir)
+                        continue;
+
+                GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+                const char *file;
+                while ((file = g_dir_read_name(dir)))
+                        g_ptr_array_add(files, g_strdup(file));
+                g_dir_close(dir);
+
+                for (int i = 0; i < G_N_ELEMENTS(extensions); i++)
+                        icon_index_add(*folder, files, extensions[i]);
+                g_ptr_array_free(files, true);
+        }
+
+        stale = false;
+}
+
+static void icon_index_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+                               GFileMonitorEvent event, gpointer data)
+{
+        if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT
+            && event != G_FILE_MONITOR_EVENT_CREATED
+            && event != G_FILE_MONITOR_EVENT_DELETED)
+                return;
+
+        icon_index_invalidate();
+        /* the decoded icons may be outdated as well */
+        icon_cache_clear();
+}
+
+static void monitor_free(gpointer data)
+{
+        g_file_monitor_cancel(data);
+        g_object_unref(data);
+}
+
+/*
+ * Watch the folders, including the ones which don't exist yet, so that
+ * creating them later marks the index stale as well.
+ */
+static void icon_index_watch(void)
+{
+        monitors = g_ptr_array_new_with_free_func(monitor_free);
+
+        for (char **folder = folders; *folder; folder++) {
+                if (!**folder)
+                        continue;
+
+                GError *error = NULL;
+                GFile *file = g_file_new_for_path(*folder);
+                GFileMonitor *monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE,
+                                                                 NULL, &error);
+                g_object_unref(file);
+
+                if (!monitor) {
+                        fprintf(stderr, "Unable to watch %s: %s\n", *folder, error->message);
+                        g_error_free(error);
+                        continue;
+                }
+
+                g_signal_connect(monitor, "changed", G_CALLBACK(icon_index_changed), NULL);
+                g_ptr_array_add(monitors, monitor);
+        }
+}
+
+void icon_index_build(const char *icon_path)
+{
+        if (icons && g_strcmp0(icon_path, indexed_path) == 0)
+                return;
+
+        icon_index_free();
+
+        indexed_path = g_strdup(icon_path);
+        folders = g_strsplit(icon_path ? icon_path : "", ":", -1);
+
+        icon_index_scan();
+        icon_index_watch();
+}
+
+/*
+ * Look for name in the folders like the index does, for names which
+ * refer to subfolders.
+ */
+static GPtrArray *icon_index_probe(const char *name)
+{
+        GPtrArray *paths = g_ptr_array_new();
+
+        for (char **folder = folders; folder && *folder; folder++) {
+                for (int i = 0; i < G_N_ELEMENTS(extensions); i++) {
+                        char *path = g_strconcat(*folder, "/", name, extensions[i], NULL);
+                        if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+                                g_ptr_array_add(paths, path);
+                        else
+                                g_free(path);
+                }
+        }
+        return paths;
+}
+
+char **icon_index_lookup_all(const char *name)
+{
+        if (!icons || !name)
+                return NULL;
+
+        GPtrArray *found;
+        if (strchr(name, '/')) {
+                found = icon_index_probe(name);
+        } else {
+                if (stale)
+                        icon_index_scan();
+
+                found = g_ptr_array_new();
+                GPtrArray *paths = g_hash_table_lookup(icons, name);
+                for (guint i = 0; paths && i < paths->len; i++)
+                        g_ptr_array_add(found, g_strdup(paths->pdata[i]));
+        }
+
+        if (found->len == 0) {
+                g_ptr_array_free(found, true);
+                return NULL;
+        }
+
+        g_ptr_array_add(found, NULL);
+        return (char **) g_ptr_array_free(found, false);
+}
+
+char *icon_index_lookup(const char *name)
+{
+        char **paths = icon_index_lookup_all(name);
+        if (!paths)
+                return NULL;
+
+        char *path = g_strdup(paths[0]);
+        g_strfreev(paths);
+        return path;
+}
+
+void icon_index_invalidate(void)
+{
+        stale = true;
+}
+
+void icon_index_free(void)
+{
+        if (monitors) {
+                g_ptr_array_free(monitors, true);
+                monitors = NULL;
+        }
+        if (icons) {
+                g_hash_table_destroy(icons);
+                icons = NULL;
+        }
+        g_strfreev(folders);
+        folders = NULL;
+        g_free(indexed_path);
+        indexed_path = NULL;
+        stale = false;
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
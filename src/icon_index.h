@@ -0,0 +1,40 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#ifndef DUNST_ICON_INDEX_H
+#define DUNST_ICON_INDEX_H
+
+/*
+ * Index the icons in the folders of icon_path, a colon separated list,
+ * and watch the folders for changes. Nothing happens, if icon_path is
+ * already indexed.
+ */
+void icon_index_build(const char *icon_path);
+
+/*
+ * Find the file of the icon called name. The first folder in icon_path
+ * containing name.svg or name.png wins, svg files are preferred.
+ *
+ * Returns a newly allocated path or NULL, if there is no such icon.
+ */
+char *icon_index_lookup(const char *name);
+
+/*
+ * Find all files of the icon called name, in the order icon_index_lookup
+ * prefers them, to fall back on if the first one can't be loaded.
+ *
+ * Returns a newly allocated, NULL terminated array or NULL, if there is
+ * no such icon.
+ */
+char **icon_index_lookup_all(const char *name);
+
+/*
+ * Scan the folders again on the next lookup.
+ */
+void icon_index_invalidate(void);
+
+/*
+ * Free the index and stop watching the folders.
+ */
+void icon_index_free(void);
+
+#endif
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
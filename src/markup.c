@@ -3,45 +3,213 @@
 #include "markup.h"
 
 #include <assert.h>
+#include <glib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "settings.h"
 #include "utils.h"
 
-static char *markup_quote(char *str)
+/* the entities, which get unquoted */
+static const struct {
+        const char *entity;
+        char c;
+} markup_entities[] = {
+        { "&quot;", '"' },
+        { "&apos;", '\'' },
+        { "&lt;", '<' },
+        { "&gt;", '>' },
+        { "&amp;", '&' },
+};
+
+/* the length of the longest entity */
+#define MARKUP_ENTITY_MAX 6
+
+/*
+ * The stages of a transcoder, in the order the characters pass them:
+ *
+ * br2nl:          replace <br>, <br/> and <br /> with newlines
+ * strip:          drop all tags
+ * unquote:        replace the entities with their characters
+ * quote:          replace special characters with entities
+ * ignore_newline: replace newlines with spaces
+ *
+ * Every character gets passed on to the next stage as soon as possible,
+ * so the input is only read once and the output written once.
+ */
+struct markup_transcoder {
+        bool br2nl;
+        bool strip;
+        bool unquote;
+        bool quote;
+        bool ignore_newline;
+
+        string_builder *out;
+        int tags;                               /* open tags while stripping */
+        char entity[MARKUP_ENTITY_MAX];         /* possible entity while unquoting */
+        int entity_len;
+};
+
+static void markup_put_quoted(struct markup_transcoder *t, char c)
 {
-        assert(str != NULL);
+        if (c == '\n' && t->ignore_newline)
+                c = ' ';
+
+        if (t->quote)
+                string_builder_append_escaped(t->out, &c, 1);
+        else
+                string_builder_append(t->out, &c, 1);
+}
+
+static void markup_put_unquoted(struct markup_transcoder *t, char c)
+{
+        if (!t->unquote) {
+                markup_put_quoted(t, c);
+                return;
+        }
+
+        if (t->entity_len == 0 && c != '&') {
+                markup_put_quoted(t, c);
+                return;
+        }
+
+        t->entity[t->entity_len++] = c;
 
-        str = string_replace_all("&", "&amp;", str);
-        str = string_replace_all("\"", "&quot;", str);
-        str = string_replace_all("'", "&apos;", str);
-        str = string_replace_all("<", "&lt;", str);
-        str = string_replace_all(">", "&gt;", str);
+        bool prefix = false;
+        for (int i = 0; i < G_N_ELEMENTS(markup_entities); i++) {
+                const char *entity = markup_entities[i].entity;
+
+                if (strncmp(entity, t->entity, t->entity_len) != 0)
+                        continue;
+
+                if (entity[t->entity_len] == '\0') {
+                        t->entity_len = 0;
+                        markup_put_quoted(t, markup_entities[i].c);
+                        return;
+                }
+                prefix = true;
+        }
 
-        return str;
+        if (prefix)
+                return;
+
+        /* not an entity, but another one might start after the '&' */
+        char pending[MARKUP_ENTITY_MAX];
+        int pending_len = t->entity_len - 1;
+        memcpy(pending, t->entity + 1, pending_len);
+        t->entity_len = 0;
+
+        markup_put_quoted(t, '&');
+        for (int i = 0; i < pending_len; i++)
+                markup_put_unquoted(t, pending[i]);
 }
 
-static char *markup_unquote(char *str)
+static void markup_put_stripped(struct markup_transcoder *t, char c)
 {
-        assert(str != NULL);
+        if (!t->strip) {
+                markup_put_unquoted(t, c);
+                return;
+        }
+
+        if (c == '<') {
+                t->tags++;
+        } else if (c == '>' && t->tags > 0) {
+                t->tags--;
+        } else if (t->tags == 0) {
+                markup_put_unquoted(t, c);
+        }
+}
 
-        str = string_replace_all("&quot;", "\"", str);
-        str = string_replace_all("&apos;", "'", str);
-        str = string_replace_all("&lt;", "<", str);
-        str = string_replace_all("&gt;", ">", str);
-        str = string_replace_all("&amp;", "&", str);
+/*
+ * Pass on a run of characters, which no stage would change on
+ * their own.
+ */
+static void markup_put_run(struct markup_transcoder *t, const char *run, size_t len)
+{
+        /* finish a possible entity first */
+        while (len > 0 && t->entity_len > 0 && t->tags == 0) {
+                markup_put_stripped(t, *run++);
+                len--;
+        }
 
-        return str;
+        if (t->tags == 0)
+                string_builder_append(t->out, run, len);
 }
 
-static char *markup_br2nl(char *str)
+/*
+ * Returns the length of the line break tag at str or 0, if
+ * there is none.
+ */
+static int markup_br_len(const char *str)
+{
+        if (strncmp(str, "<br", 3) != 0)
+                return 0;
+        if (str[3] == '>')
+                return 4;
+        if (str[3] == '/' && str[4] == '>')
+                return 5;
+        if (str[3] == ' ' && str[4] == '/' && str[5] == '>')
+                return 6;
+        return 0;
+}
+
+/*
+ * Run str through the stages of the transcoder.
+ *
+ * Returns the transcoded string and frees str. If no stage would
+ * change str, str is returned as it is.
+ */
+static char *markup_transcode(struct markup_transcoder *t, char *str)
 {
         assert(str != NULL);
 
-        str = string_replace_all("<br>", "\n", str);
-        str = string_replace_all("<br/>", "\n", str);
-        str = string_replace_all("<br />", "\n", str);
-        return str;
+        char special[8];
+        int n = 0;
+
+        if (t->br2nl || t->strip || t->quote)
+                special[n++] = '<';
+        if (t->strip || t->quote)
+                special[n++] = '>';
+        if (t->unquote || t->quote)
+                special[n++] = '&';
+        if (t->quote) {
+                special[n++] = '"';
+                special[n++] = '\'';
+        }
+        if (t->ignore_newline)
+                special[n++] = '\n';
+        special[n] = '\0';
+
+        /* nothing to do */
+        char *start = strpbrk(str, special);
+        if (!start)
+                return str;
+
+        size_t len = strlen(str);
+        t->out = string_builder_new(len);
+        string_builder_append(t->out, str, start - str);
+
+        for (const char *c = start; *c; c++) {
+                int br_len;
+                size_t run = strcspn(c, special);
+
+                if (run > 0) {
+                        markup_put_run(t, c, run);
+                        c += run - 1;
+                } else if (t->br2nl && *c == '<' && (br_len = markup_br_len(c))) {
+                        markup_put_stripped(t, '\n');
+                        c += br_len - 1;
+                } else {
+                        markup_put_stripped(t, *c);
+                }
+        }
+
+        /* an incomplete entity at the end */
+        for (int i = 0; i < t->entity_len; i++)
+                markup_put_quoted(t, t->entity[i]);
+        g_free(str);
+
+        return string_builder_steal(t->out);
 }
 
 /*
@@ -62,13 +230,12 @@ char *markup_strip(char *str)
                 return NULL;
         }
 
-        /* strip all tags */
-        string_strip_delimited(str, '<', '>');
-
-        /* unquote the remainder */
-        str = markup_unquote(str);
+        struct markup_transcoder t = {
+                .strip = true,
+                .unquote = true,
+        };
 
-        return str;
+        return markup_transcode(&t, str);
 }
 
 /*
@@ -81,29 +248,30 @@ char *markup_transform(char *str, enum markup_mode markup_mode)
                 return NULL;
         }
 
+        struct markup_transcoder t = {
+                .ignore_newline = settings.ignore_newline,
+        };
+
         switch (markup_mode) {
         case MARKUP_NULL:
                 /* `assert(false)`, but with a meaningful error message */
                 assert(markup_mode != MARKUP_NULL);
                 break;
         case MARKUP_NO:
-                str = markup_quote(str);
+                t.quote = true;
                 break;
         case MARKUP_STRIP:
-                str = markup_br2nl(str);
-                str = markup_strip(str);
-                str = markup_quote(str);
+                t.br2nl = true;
+                t.strip = true;
+                t.unquote = true;
+                t.quote = true;
                 break;
         case MARKUP_FULL:
-                str = markup_br2nl(str);
+                t.br2nl = true;
                 break;
         }
 
-        if (settings.ignore_newline) {
-                str = string_replace_all("\n", " ", str);
-        }
-
-        return str;
+        return markup_transcode(&t, str);
 }
 
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -4,7 +4,6 @@
 
 #include <errno.h>
 #include <glib.h>
-#include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,74 +18,209 @@
 #include "settings.h"
 #include "utils.h"
 
-static bool is_initialized = false;
-static regex_t cregex;
+/* the schemes and prefixes, which start an url (case insensitive) */
+static const char *url_prefixes[] = {
+        "http://",
+        "https://",
+        "ftp://",
+        "ftps://",
+        "news://",
+        "mailto:",
+        "file://",
+        "www.",
+};
 
-static int regex_init(void)
+/*
+ * Every url prefix contains one of these characters after its
+ * letters, which is much rarer in text than the letters themselves.
+ */
+#define URL_PREFIX_ANCHORS ":."
+
+/* characters besides alphanumeric ones allowed anywhere in an url body */
+#define URL_CHARS "-_\\@;/?:&=%$+*~"
+/* characters allowed in an url, but not at its end */
+#define URL_INNER_CHARS ".!',#"
+
+enum url_char {
+        URL_CHAR_NONE,          /* not part of an url */
+        URL_CHAR_INNER,         /* part of an url, but it can't end with it */
+        URL_CHAR_END,           /* part of an url, which can end with it */
+};
+
+static bool url_is_word_char(gunichar c)
 {
-        if (is_initialized)
-                return 1;
-
-        char *regex =
-            "\\b(https?://|ftps?://|news://|mailto:|file://|www\\.)"
-            "[-[:alnum:]_\\@;/?:&=%$.+!*\x27,~#]*"
-            "(\\([-[:alnum:]_\\@;/?:&=%$.+!*\x27,~#]*\\)|[-[:alnum:]_\\@;/?:&=%$+*~])+";
-        int ret = regcomp(&cregex, regex, REG_EXTENDED | REG_ICASE);
-        if (ret != 0) {
-                fputs("failed to compile regex", stderr);
-                return 0;
-        } else {
-                is_initialized = true;
-                return 1;
+        return c == '_' || g_unichar_isalnum(c);
+}
+
+/*
+ * Classify the character at str and store its length in bytes in len.
+ *
+ * Non-ASCII characters are decoded as UTF-8 and count as
+ * alphanumeric, if they are letters or digits in Unicode.
+ */
+static enum url_char url_char_at(const char *str, int *len)
+{
+        unsigned char c = *str;
+        *len = 1;
+
+        if (c < 0x80) {
+                if (c == '\0')
+                        return URL_CHAR_NONE;
+                if (g_ascii_isalnum(c) || strchr(URL_CHARS, c))
+                        return URL_CHAR_END;
+                if (strchr(URL_INNER_CHARS, c))
+                        return URL_CHAR_INNER;
+                return URL_CHAR_NONE;
         }
+
+        gunichar u = g_utf8_get_char_validated(str, -1);
+        if (u == (gunichar) -1 || u == (gunichar) -2 || !g_unichar_isalnum(u))
+                return URL_CHAR_NONE;
+
+        *len = g_utf8_skip[c];
+        return URL_CHAR_END;
 }
 
-void regex_teardown(void)
+/*
+ * Returns the start of the url prefix containing the anchor
+ * character at anchor and stores its length in len, or returns NULL,
+ * if there is none starting at or after str.
+ */
+static const char *url_prefix_at(const char *str, const char *anchor, size_t *len)
 {
-        if (is_initialized) {
-                regfree(&cregex);
-                is_initialized = false;
+        for (int i = 0; i < G_N_ELEMENTS(url_prefixes); i++) {
+                const char *prefix = url_prefixes[i];
+                size_t offset = strcspn(prefix, URL_PREFIX_ANCHORS);
+
+                if (prefix[offset] != *anchor || anchor - str < offset)
+                        continue;
+
+                *len = strlen(prefix);
+                if (g_ascii_strncasecmp(anchor - offset, prefix, *len) == 0)
+                        return anchor - offset;
         }
+        return NULL;
 }
 
 /*
- * Exctract all urls from a given string.
- *
- * Return: a string of urls separated by \n
+ * Returns the length of the longest url body at str.
  *
+ * An url body consists of url characters, optionally followed by
+ * groups of url characters in parentheses, which may be mixed with
+ * further url characters allowed at the end. It has to end with one
+ * of these or a closing parenthesis.
  */
-char *extract_urls(const char *to_match)
+static size_t url_body_len(const char *str)
 {
-        char *urls = NULL;
+        enum { BEFORE_GROUP, IN_GROUP, AFTER_GROUP } state = BEFORE_GROUP;
+        size_t len = 0;
+        int char_len;
+
+        for (const char *c = str; *c; c += char_len) {
+                enum url_char type = url_char_at(c, &char_len);
+                bool end = false;
+
+                switch (state) {
+                case BEFORE_GROUP:
+                        if (*c == '(')
+                                state = IN_GROUP;
+                        else if (type == URL_CHAR_NONE)
+                                return len;
+                        else
+                                end = type == URL_CHAR_END;
+                        break;
+                case IN_GROUP:
+                        if (*c == ')') {
+                                state = AFTER_GROUP;
+                                end = true;
+                        } else if (type == URL_CHAR_NONE) {
+                                return len;
+                        }
+                        break;
+                case AFTER_GROUP:
+                        if (*c == '(')
+                                state = IN_GROUP;
+                        else if (type != URL_CHAR_END)
+                                return len;
+                        else
+                                end = true;
+                        break;
+                }
 
-        if (!regex_init())
-                return NULL;
+                if (end)
+                        len = c + char_len - str;
+        }
 
-        const char *p = to_match;
-        regmatch_t m;
+        return len;
+}
 
-        while (1) {
-                int nomatch = regexec(&cregex, p, 1, &m, 0);
-                if (nomatch) {
-                        return urls;
-                }
-                int start;
-                int finish;
-                if (m.rm_so == -1) {
-                        break;
+/*
+ * Find the next url in str.
+ *
+ * Returns a pointer to its start and stores its length in len, or
+ * returns NULL, if there is no url left.
+ */
+static const char *url_find(const char *str, size_t *len)
+{
+        for (const char *anchor = strpbrk(str, URL_PREFIX_ANCHORS);
+                         anchor;
+                         anchor = strpbrk(anchor + 1, URL_PREFIX_ANCHORS)) {
+
+                size_t prefix_len;
+                const char *start = url_prefix_at(str, anchor, &prefix_len);
+                if (!start)
+                        continue;
+
+                /* urls have to start at a word boundary */
+                if (start > str) {
+                        const char *prev = g_utf8_find_prev_char(str, start);
+                        gunichar u = g_utf8_get_char_validated(prev, start - prev);
+                        if (u != (gunichar) -1 && u != (gunichar) -2 && url_is_word_char(u))
+                                continue;
                 }
-                start = m.rm_so + (p - to_match);
-                finish = m.rm_eo + (p - to_match);
 
-                char *match = g_strndup(to_match + start, finish - start);
+                size_t body_len = url_body_len(start + prefix_len);
+                if (body_len == 0)
+                        continue;
 
-                urls = string_append(urls, match, "\n");
+                *len = prefix_len + body_len;
+                return start;
+        }
 
-                g_free(match);
+        return NULL;
+}
 
-                p += m.rm_eo;
+/*
+ * Exctract all urls from a given string.
+ *
+ * Return: a string of urls separated by \n
+ *
+ */
+char *extract_urls(const char *to_match)
+{
+        string_builder *urls = NULL;
+        const char *url;
+        size_t len;
+
+        for (const char *p = to_match; (url = url_find(p, &len)) != NULL; p = url + len) {
+                if (urls)
+                        string_builder_append(urls, "\n", 1);
+                else
+                        urls = string_builder_new(0);
+                string_builder_append(urls, url, len);
         }
-        return urls;
+
+        return urls ? string_builder_steal(urls) : NULL;
+}
+
+/*
+ * Check whether str contains an url, without extracting it.
+ */
+bool contains_url(const char *str)
+{
+        size_t len;
+
+        return str && url_find(str, &len) != NULL;
 }
 
 /*
@@ -187,23 +321,30 @@ void context_menu(void)
                 fprintf(stderr, "dmenu command not set properly. Cowardly refusing to open the context menu.\n");
                 return;
         }
-        char *dmenu_input = NULL;
+        string_builder *input = string_builder_new(0);
 
         for (const GList *iter = queues_get_displayed(); iter;
              iter = iter->next) {
                 notification *n = iter->data;
+                const char *entries[] = {
+                        notification_urls(n),
+                        notification_dmenu_str(n),
+                };
 
-                if (n->urls)
-                        dmenu_input = string_append(dmenu_input, n->urls, "\n");
-
-                if (n->actions)
-                        dmenu_input =
-                            string_append(dmenu_input, n->actions->dmenu_str,
-                                          "\n");
+                for (int i = 0; i < G_N_ELEMENTS(entries); i++) {
+                        if (!entries[i] || *entries[i] == '\0')
+                                continue;
+                        if (input->len > 0)
+                                string_builder_append(input, "\n", 1);
+                        string_builder_append(input, entries[i], -1);
+                }
         }
 
-        if (!dmenu_input)
+        if (input->len == 0) {
+                string_builder_free(input);
                 return;
+        }
+        char *dmenu_input = string_builder_steal(input);
 
         char buf[1024] = {0};
         int child_io[2];
@@ -2,10 +2,12 @@
 #ifndef DUNST_MENU_H
 #define DUNST_MENU_H
 
+#include <stdbool.h>
+
 char *extract_urls(const char *to_match);
+bool contains_url(const char *str);
 void open_browser(const char *in);
 void invoke_action(const char *action);
-void regex_teardown(void);
 
 #endif
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -5,7 +5,6 @@
 #include <assert.h>
 #include <errno.h>
 #include <glib.h>
-#include <libgen.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +14,7 @@
 
 #include "dbus.h"
 #include "dunst.h"
+#include "format.h"
 #include "markup.h"
 #include "menu.h"
 #include "queues.h"
@@ -44,7 +44,7 @@ void notification_print(notification *n)
         printf("\tbg: %s\n", n->color_strings[ColBG]);
         printf("\tframe: %s\n", n->color_strings[ColFrame]);
         printf("\tid: %d\n", n->id);
-        if (n->urls) {
+        if (notification_urls(n)) {
                 printf("\turls:\n");
                 printf("\t{\n");
                 printf("\t\t%s\n", n->urls);
@@ -59,7 +59,7 @@ void notification_print(notification *n)
                                n->actions->actions[i + 1]);
                 }
                 printf("\t}\n");
-                printf("\tactions_dmenu: %s\n", n->actions->dmenu_str);
+                printf("\tactions_dmenu: %s\n", notification_dmenu_str(n));
         }
         printf("\tscript: %s\n", n->script);
         printf("}\n");
@@ -156,18 +156,60 @@ int notification_cmp_data(const void *va, const void *vb, void *data)
 
 int notification_is_duplicate(const notification *a, const notification *b)
 {
-        //Comparing raw icons is not supported, assume they are not identical
-        if (settings.icon_position != icons_off
-                && (a->raw_icon != NULL || b->raw_icon != NULL))
+        if (a->fingerprint != b->fingerprint)
                 return false;
 
+        if (settings.icon_position != icons_off) {
+                if (a->raw_icon || b->raw_icon) {
+                        if (!rawimage_equal(a->raw_icon, b->raw_icon))
+                                return false;
+                } else if (strcmp(a->icon, b->icon) != 0) {
+                        return false;
+                }
+        }
+
         return strcmp(a->appname, b->appname) == 0
             && strcmp(a->summary, b->summary) == 0
             && strcmp(a->body,    b->body) == 0
-            && (settings.icon_position != icons_off ? strcmp(a->icon, b->icon) == 0 : 1)
             && a->urgency == b->urgency;
 }
 
+static guint64 hash_string(const char *str, guint64 seed)
+{
+        /* include the terminator, so that field boundaries count */
+        return str ? hash_data(str, strlen(str) + 1, seed) : hash_data("", 0, seed);
+}
+
+/*
+ * Compute the fingerprint of all fields, which are relevant
+ * for notification_is_duplicate.
+ */
+guint64 notification_fingerprint(const notification *n)
+{
+        guint64 h = 0;
+
+        h = hash_string(n->appname, h);
+        h = hash_string(n->summary, h);
+        h = hash_string(n->body, h);
+        h = hash_data(&n->urgency, sizeof(n->urgency), h);
+
+        if (settings.icon_position != icons_off) {
+                if (n->raw_icon) {
+                        const RawImage *i = n->raw_icon;
+                        int dims[] = {
+                                i->width, i->height, i->rowstride,
+                                i->has_alpha, i->bits_per_sample, i->n_channels
+                        };
+                        h = hash_data(dims, sizeof(dims), h);
+                        h = hash_data(i->data, rawimage_data_size(i), h);
+                } else {
+                        h = hash_string(n->icon, h);
+                }
+        }
+
+        return h;
+}
+
 /*
  * Free the actions element
  * @a: (nullable): Pointer to #Actions
@@ -183,16 +225,90 @@ void actions_free(Actions *a)
 }
 
 /*
- * Free a #RawImage
- * @i: (nullable): pointer to #RawImage
+ * Release everything n only needs while being displayed, so that
+ * it can be kept in history. Raw icons get scaled down or dropped
+ * according to settings.history_raw_icon.
+ *
+ * Call notification_format_message to make n displayable again.
  */
-void rawimage_free(RawImage *i)
+void notification_compact(notification *n)
 {
-        if (!i)
+        g_free(n->msg);
+        n->msg = NULL;
+        g_free(n->text_to_render);
+        n->text_to_render = NULL;
+
+        /* extracted again when needed */
+        g_free(n->urls);
+        n->urls = NULL;
+        n->urls_extracted = false;
+        if (n->actions) {
+                g_free(n->actions->dmenu_str);
+                n->actions->dmenu_str = NULL;
+        }
+
+        if (!n->raw_icon)
                 return;
 
-        g_free(i->data);
-        g_free(i);
+        if (settings.history_raw_icon == HISTORY_RAW_ICON_DROP
+            || settings.icon_position == icons_off) {
+                rawimage_free(n->raw_icon);
+                n->raw_icon = NULL;
+        } else if (settings.history_raw_icon == HISTORY_RAW_ICON_SCALE
+                   && settings.max_icon_size > 0) {
+                RawImage *scaled = rawimage_scale_down(n->raw_icon, settings.max_icon_size);
+                if (scaled) {
+                        rawimage_free(n->raw_icon);
+                        n->raw_icon = rawimage_intern(scaled);
+                }
+        }
+
+        /* history may keep n for long, don't pin its D-Bus message */
+        if (n->raw_icon)
+                rawimage_detach(n->raw_icon);
+
+        if (!n->raw_icon && !n->icon)
+                n->icon = g_strdup(settings.icons[n->urgency]);
+
+        n->fingerprint = notification_fingerprint(n);
+}
+
+static gsize string_size(const char *s)
+{
+        return s ? strlen(s) + 1 : 0;
+}
+
+/*
+ * Return the amount of memory in bytes held by n, counting its
+ * strings, raw icon and actions.
+ */
+gsize notification_size(const notification *n)
+{
+        gsize size = sizeof(notification);
+
+        size += string_size(n->appname);
+        size += string_size(n->summary);
+        size += string_size(n->body);
+        size += string_size(n->icon);
+        size += string_size(n->msg);
+        size += string_size(n->category);
+        size += string_size(n->text_to_render);
+        size += string_size(n->dbus_client);
+        size += string_size(n->urls);
+        size += string_size(n->link_urls);
+
+        if (n->raw_icon)
+                size += sizeof(RawImage) + rawimage_data_size(n->raw_icon);
+
+        if (n->actions) {
+                size += sizeof(Actions);
+                size += (n->actions->count + 1) * sizeof(char *);
+                for (gsize i = 0; i < n->actions->count; i++)
+                        size += string_size(n->actions->actions[i]);
+                size += string_size(n->actions->dmenu_str);
+        }
+
+        return size;
 }
 
 /*
@@ -210,6 +326,7 @@ void notification_free(notification *n)
         g_free(n->category);
         g_free(n->text_to_render);
         g_free(n->urls);
+        g_free(n->link_urls);
 
         actions_free(n->actions);
         rawimage_free(n->raw_icon);
@@ -248,44 +365,141 @@ void notification_replace_single_field(char **haystack,
         g_free(input);
 }
 
+/*
+ * Replace the links in *str_ptr with "[text #n]" and return their
+ * urls as "[#n] url" lines. Links without url get removed.
+ */
 char *notification_extract_markup_urls(char **str_ptr)
 {
-        char *start, *end, *replace_buf, *str, *urls = NULL, *url, *index_buf;
+        char *str = *str_ptr;
+        const char *read, *c;
+        bool links = true;
         int linkno = 1;
 
-        str = *str_ptr;
-        while ((start = strstr(str, "<a href")) != NULL) {
-                end = strstr(start, ">");
-                if (end != NULL) {
-                        replace_buf = g_strndup(start, end - start + 1);
-                        url = extract_urls(replace_buf);
-                        if (url != NULL) {
-                                str = string_replace(replace_buf, "[", str);
-
-                                index_buf = g_strdup_printf("[#%d]", linkno++);
-                                if (urls == NULL) {
-                                        urls = g_strconcat(index_buf, " ", url, NULL);
-                                } else {
-                                        char *tmp = urls;
-                                        urls = g_strconcat(tmp, "\n", index_buf, " ", url, NULL);
-                                        g_free(tmp);
-                                }
-
-                                index_buf[0] = ' ';
-                                str = string_replace("</a>", index_buf, str);
-                                g_free(index_buf);
+        if (!strstr(str, "<a href"))
+                return NULL;
+
+        string_builder *out = string_builder_new(strlen(str));
+        string_builder *urls = NULL;
+
+        /* the link numbers of the open links, 0 for removed ones */
+        GQueue open = G_QUEUE_INIT;
+
+        for (read = c = str; (c = strchr(c, '<')) != NULL; ) {
+                if (links && strncmp(c, "<a href", 7) == 0) {
+                        const char *end = strchr(c, '>');
+                        if (!end) {
+                                links = false;
+                                c++;
+                                continue;
+                        }
+
+                        string_builder_append(out, read, c - read);
+
+                        char *tag = g_strndup(c, end - c + 1);
+                        char *url = extract_urls(tag);
+                        if (url) {
+                                string_builder_append(out, "[", 1);
+
+                                if (urls)
+                                        string_builder_append(urls, "\n", 1);
+                                else
+                                        urls = string_builder_new(0);
+                                string_builder_append_printf(urls, "[#%d] %s", linkno, url);
+
+                                g_queue_push_tail(&open, GINT_TO_POINTER(linkno++));
                                 g_free(url);
                         } else {
-                                str = string_replace(replace_buf, "", str);
-                                str = string_replace("</a>", "", str);
+                                g_queue_push_tail(&open, GINT_TO_POINTER(0));
                         }
-                        g_free(replace_buf);
+                        g_free(tag);
+
+                        read = c = end + 1;
+                } else if (!g_queue_is_empty(&open) && strncmp(c, "</a>", 4) == 0) {
+                        string_builder_append(out, read, c - read);
+
+                        int link = GPOINTER_TO_INT(g_queue_pop_head(&open));
+                        if (link)
+                                string_builder_append_printf(out, " #%d]", link);
+
+                        read = c = c + 4;
                 } else {
-                        break;
+                        c++;
                 }
         }
-        *str_ptr = str;
-        return urls;
+        string_builder_append(out, read, -1);
+        g_queue_clear(&open);
+
+        g_free(str);
+        *str_ptr = string_builder_steal(out);
+
+        return urls ? string_builder_steal(urls) : NULL;
+}
+
+/*
+ * Return the urls of n separated by newlines or NULL, if there are
+ * none. They get extracted from the summary and body on first use,
+ * as most notifications never show up in the context menu.
+ */
+const char *notification_urls(notification *n)
+{
+        if (n->urls_extracted)
+                return n->urls;
+
+        char *tmp = g_strconcat(n->summary, " ", n->body, NULL);
+        char *tmp_urls = extract_urls(tmp);
+
+        n->urls = string_append(g_strdup(n->link_urls), tmp_urls, "\n");
+        n->urls_extracted = true;
+
+        g_free(tmp_urls);
+        g_free(tmp);
+
+        return n->urls;
+}
+
+/*
+ * Check whether n has any urls, without extracting them. The answer
+ * is remembered, as it's needed on every redraw.
+ */
+bool notification_has_urls(notification *n)
+{
+        if (n->urls_extracted)
+                return n->urls != NULL;
+
+        if (n->has_urls == URLS_UNKNOWN)
+                n->has_urls = n->link_urls || contains_url(n->summary) || contains_url(n->body)
+                              ? URLS_SOME : URLS_NONE;
+
+        return n->has_urls == URLS_SOME;
+}
+
+/*
+ * Return the context menu entries for the actions of n separated by
+ * newlines or NULL, if there are none. They get built on first use.
+ */
+const char *notification_dmenu_str(notification *n)
+{
+        if (!n->actions || n->actions->dmenu_str)
+                return n->actions ? n->actions->dmenu_str : NULL;
+
+        string_builder *dmenu_str = string_builder_new(0);
+        for (int i = 0; i < n->actions->count; i += 2) {
+                char *human_readable = n->actions->actions[i + 1];
+                string_replace_char('[', '(', human_readable); // kill square brackets
+                string_replace_char(']', ')', human_readable);
+
+                if (i > 0)
+                        string_builder_append(dmenu_str, "\n", 1);
+                string_builder_append_printf(dmenu_str, "#%s [%s]", human_readable, n->appname);
+        }
+
+        if (dmenu_str->len > 0)
+                n->actions->dmenu_str = string_builder_steal(dmenu_str);
+        else
+                string_builder_free(dmenu_str);
+
+        return n->actions->dmenu_str;
 }
 
 /*
@@ -306,6 +520,28 @@ void notification_init_defaults(notification *n)
         if(n->category == NULL) n->category = g_strdup("");
 }
 
+/*
+ * Generate the formatted message n->msg out of n->format
+ * with the precompiled template of the format.
+ */
+void notification_format_message(notification *n)
+{
+        g_free(n->msg);
+        n->msg = format_expand(format_compile(n->format), n);
+
+        n->msg = g_strchomp(n->msg);
+
+        /* truncate overlong messages */
+        if (strlen(n->msg) > DUNST_NOTIF_MAX_CHARS) {
+                char *buffer = g_malloc(DUNST_NOTIF_MAX_CHARS);
+                strncpy(buffer, n->msg, DUNST_NOTIF_MAX_CHARS);
+                buffer[DUNST_NOTIF_MAX_CHARS-1] = '\0';
+
+                g_free(n->msg);
+                n->msg = buffer;
+        }
+}
+
 /*
  * Initialize the given notification
  *
@@ -336,108 +572,10 @@ void notification_init(notification *n)
                 n->icon = g_strdup(settings.icons[n->urgency]);
         }
 
-        n->urls = notification_extract_markup_urls(&(n->body));
-
-        n->msg = string_replace_all("\\n", "\n", g_strdup(n->format));
-
-        /* replace all formatter */
-        for(char *substr = strchr(n->msg, '%');
-                  substr;
-                  substr = strchr(substr, '%')) {
-
-                char pg[16];
-                char *icon_tmp;
-
-                switch(substr[1]) {
-                case 'a':
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->appname,
-                                MARKUP_NO);
-                        break;
-                case 's':
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->summary,
-                                n->markup);
-                        break;
-                case 'b':
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->body,
-                                n->markup);
-                        break;
-                case 'I':
-                        icon_tmp = g_strdup(n->icon);
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                icon_tmp ? basename(icon_tmp) : "",
-                                MARKUP_NO);
-                        g_free(icon_tmp);
-                        break;
-                case 'i':
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->icon ? n->icon : "",
-                                MARKUP_NO);
-                        break;
-                case 'p':
-                        if (n->progress != -1)
-                                sprintf(pg, "[%3d%%]", n->progress);
-
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->progress != -1 ? pg : "",
-                                MARKUP_NO);
-                        break;
-                case 'n':
-                        if (n->progress != -1)
-                                sprintf(pg, "%d", n->progress);
-
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                n->progress != -1 ? pg : "",
-                                MARKUP_NO);
-                        break;
-                case '%':
-                        notification_replace_single_field(
-                                &n->msg,
-                                &substr,
-                                "%",
-                                MARKUP_NO);
-                        break;
-                case '\0':
-                        fprintf(stderr, "WARNING: format_string has trailing %% character."
-                                        "To escape it use %%%%.");
-                        break;
-                default:
-                        fprintf(stderr, "WARNING: format_string %%%c"
-                                        " is unknown\n", substr[1]);
-                        // shift substr pointer forward,
-                        // as we can't interpret the format string
-                        substr++;
-                        break;
-                }
-        }
-
-        n->msg = g_strchomp(n->msg);
-
-        /* truncate overlong messages */
-        if (strlen(n->msg) > DUNST_NOTIF_MAX_CHARS) {
-                char *buffer = g_malloc(DUNST_NOTIF_MAX_CHARS);
-                strncpy(buffer, n->msg, DUNST_NOTIF_MAX_CHARS);
-                buffer[DUNST_NOTIF_MAX_CHARS-1] = '\0';
+        n->link_urls = notification_extract_markup_urls(&(n->body));
+        n->has_urls = URLS_UNKNOWN;
 
-                g_free(n->msg);
-                n->msg = buffer;
-        }
+        notification_format_message(n);
 
         n->dup_count = 0;
 
@@ -469,28 +607,7 @@ void notification_init(notification *n)
 
         n->first_render = true;
 
-        char *tmp = g_strconcat(n->summary, " ", n->body, NULL);
-
-        char *tmp_urls = extract_urls(tmp);
-        n->urls = string_append(n->urls, tmp_urls, "\n");
-        g_free(tmp_urls);
-
-        if (n->actions) {
-                n->actions->dmenu_str = NULL;
-                for (int i = 0; i < n->actions->count; i += 2) {
-                        char *human_readable = n->actions->actions[i + 1];
-                        string_replace_char('[', '(', human_readable); // kill square brackets
-                        string_replace_char(']', ')', human_readable);
-
-                        char *act_str = g_strdup_printf("#%s [%s]", human_readable, n->appname);
-                        if (act_str) {
-                                n->actions->dmenu_str = string_append(n->actions->dmenu_str, act_str, "\n");
-                                g_free(act_str);
-                        }
-                }
-        }
-
-        g_free(tmp);
+        n->fingerprint = notification_fingerprint(n);
 }
 
 void notification_update_text_to_render(notification *n)
@@ -501,18 +618,19 @@ void notification_update_text_to_render(notification *n)
         char *buf = NULL;
 
         char *msg = g_strchomp(n->msg);
+        bool urls = settings.show_indicators && notification_has_urls(n);
 
         /* print dup_count and msg */
         if ((n->dup_count > 0 && !settings.hide_duplicate_count)
-            && (n->actions || n->urls) && settings.show_indicators) {
+            && (n->actions || urls) && settings.show_indicators) {
                 buf = g_strdup_printf("(%d%s%s) %s",
                                       n->dup_count,
                                       n->actions ? "A" : "",
-                                      n->urls ? "U" : "", msg);
-        } else if ((n->actions || n->urls) && settings.show_indicators) {
+                                      urls ? "U" : "", msg);
+        } else if ((n->actions || urls) && settings.show_indicators) {
                 buf = g_strdup_printf("(%s%s) %s",
                                       n->actions ? "A" : "",
-                                      n->urls ? "U" : "", msg);
+                                      urls ? "U" : "", msg);
         } else if (n->dup_count > 0 && !settings.hide_duplicate_count) {
                 buf = g_strdup_printf("(%d) %s", n->dup_count, msg);
         } else {
@@ -569,7 +687,7 @@ void notification_do_action(notification *n)
                 }
                 context_menu();
 
-        } else if (n->urls) {
+        } else if (notification_urls(n)) {
                 if (strstr(n->urls, "\n") == NULL)
                         open_browser(n->urls);
                 else
@@ -5,6 +5,7 @@
 #include <glib.h>
 #include <stdbool.h>
 
+#include "rawimage.h"
 #include "settings.h"
 
 #define DUNST_NOTIF_MAX_CHARS 5000
@@ -18,19 +19,16 @@ enum urgency {
         URG_MAX = 2,
 };
 
-typedef struct _raw_image {
-        int width;
-        int height;
-        int rowstride;
-        int has_alpha;
-        int bits_per_sample;
-        int n_channels;
-        unsigned char *data;
-} RawImage;
+/* whether a notification has urls, as remembered by notification_has_urls */
+enum urls_state {
+        URLS_UNKNOWN = 0,
+        URLS_NONE,
+        URLS_SOME,
+};
 
 typedef struct _actions {
         char **actions;
-        char *dmenu_str;
+        char *dmenu_str;        /* built on first use by notification_dmenu_str */
         gsize count;
 } Actions;
 
@@ -61,18 +59,29 @@ typedef struct _notification {
         int progress;           /* percentage (-1: undefined) */
         int history_ignore;
         const char *script;
-        char *urls;
+        char *urls;             /* extracted on first use by notification_urls */
+        char *link_urls;        /* urls of the links, which got removed from the body */
+        bool urls_extracted;
+        enum urls_state has_urls;
         Actions *actions;
+
+        guint64 fingerprint;    /* hash over the fields compared by notification_is_duplicate */
 } notification;
 
 notification *notification_create(void);
 void notification_init(notification *n);
+void notification_format_message(notification *n);
+void notification_compact(notification *n);
+gsize notification_size(const notification *n);
+const char *notification_urls(notification *n);
+bool notification_has_urls(notification *n);
+const char *notification_dmenu_str(notification *n);
 void actions_free(Actions *a);
-void rawimage_free(RawImage *i);
 void notification_free(notification *n);
 int notification_cmp(const void *a, const void *b);
 int notification_cmp_data(const void *a, const void *b, void *data);
 int notification_is_duplicate(const notification *a, const notification *b);
+guint64 notification_fingerprint(const notification *n);
 void notification_run_script(notification *n);
 void notification_print(notification *n);
 void notification_replace_single_field(char **haystack,
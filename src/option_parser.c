@@ -10,102 +10,132 @@
 
 #include "utils.h"
 
-typedef struct _entry_t {
+typedef struct _entry_key {
+        const char *section;    /* owned by sections */
         char *key;
-        char *value;
-} entry_t;
+} entry_key;
 
-typedef struct _section_t {
-        char *name;
-        int entry_count;
-        entry_t *entries;
-} section_t;
+/* section names in the order of the file */
+static GPtrArray *sections = NULL;
+/* section name -> its index in sections + 1 */
+static GHashTable *section_index = NULL;
+/* entry_key -> value */
+static GHashTable *entries = NULL;
 
-static int section_count = 0;
-static section_t *sections;
-
-static section_t *new_section(const char *name);
-static section_t *get_section(const char *name);
+static const char *new_section(const char *name);
+static const char *get_section(const char *name);
 static void add_entry(const char *section_name, const char *key, const char *value);
 static const char *get_value(const char *section, const char *key);
 static char *clean_value(const char *value);
 
 static int cmdline_argc;
 static char **cmdline_argv;
-
-static char *usage_str = NULL;
+/* argv string -> index of its first occurrence + 1 */
+static GHashTable *cmdline_index = NULL;
+/* "-key/-longkey" -> resolved index, -1 if neither is given */
+static GHashTable *cmdline_aliases = NULL;
+
+static GString *usage_str = NULL;
+/* keys already described in usage_str */
+static GHashTable *usage_keys = NULL;
 static void cmdline_usage_append(const char *key, const char *type, const char *description);
 
 static int cmdline_find_option(const char *key);
 
-section_t *new_section(const char *name)
+static guint entry_key_hash(gconstpointer data)
 {
-        for (int i = 0; i < section_count; i++) {
-                if (!strcmp(name, sections[i].name)) {
-                        die("Duplicated section in dunstrc detected.\n", -1);
-                }
+        const entry_key *k = data;
+
+        return g_str_hash(k->section) * 31 + g_str_hash(k->key);
+}
+
+static gboolean entry_key_equal(gconstpointer a, gconstpointer b)
+{
+        const entry_key *ka = a, *kb = b;
+
+        return strcmp(ka->section, kb->section) == 0
+               && strcmp(ka->key, kb->key) == 0;
+}
+
+static void entry_key_free(gpointer data)
+{
+        entry_key *k = data;
+
+        g_free(k->key);
+        g_free(k);
+}
+
+const char *new_section(const char *name)
+{
+        if (!sections) {
+                sections = g_ptr_array_new_with_free_func(g_free);
+                /* the keys belong to sections */
+                section_index = g_hash_table_new(g_str_hash, g_str_equal);
+                entries = g_hash_table_new_full(entry_key_hash, entry_key_equal,
+                                                entry_key_free, g_free);
         }
 
-        section_count++;
-        sections = g_realloc(sections, sizeof(section_t) * section_count);
-        sections[section_count - 1].name = g_strdup(name);
-        sections[section_count - 1].entries = NULL;
-        sections[section_count - 1].entry_count = 0;
-        return &sections[section_count - 1];
+        if (g_hash_table_contains(section_index, name))
+                die("Duplicated section in dunstrc detected.\n", -1);
+
+        char *section = g_strdup(name);
+        g_ptr_array_add(sections, section);
+        g_hash_table_insert(section_index, section, GUINT_TO_POINTER(sections->len));
+        return section;
 }
 
 void free_ini(void)
 {
-        for (int i = 0; i < section_count; i++) {
-                for (int j = 0; j < sections[i].entry_count; j++) {
-                        g_free(sections[i].entries[j].key);
-                        g_free(sections[i].entries[j].value);
-                }
-                g_free(sections[i].entries);
-                g_free(sections[i].name);
-        }
-        g_free(sections);
-        section_count = 0;
+        if (!sections)
+                return;
+
+        g_hash_table_destroy(entries);
+        g_hash_table_destroy(section_index);
+        g_ptr_array_free(sections, true);
+
+        entries = NULL;
+        section_index = NULL;
         sections = NULL;
 }
 
-section_t *get_section(const char *name)
+/*
+ * Get the stored name of the section or NULL, if there is no such
+ * section.
+ */
+const char *get_section(const char *name)
 {
-        for (int i = 0; i < section_count; i++) {
-                if (strcmp(sections[i].name, name) == 0)
-                        return &sections[i];
-        }
+        if (!sections)
+                return NULL;
 
-        return NULL;
+        guint index = GPOINTER_TO_UINT(g_hash_table_lookup(section_index, name));
+        return index ? g_ptr_array_index(sections, index - 1) : NULL;
 }
 
 void add_entry(const char *section_name, const char *key, const char *value)
 {
-        section_t *s = get_section(section_name);
-        if (s == NULL) {
-                s = new_section(section_name);
+        const char *section = get_section(section_name);
+        if (section == NULL) {
+                section = new_section(section_name);
         }
 
-        s->entry_count++;
-        int len = s->entry_count;
-        s->entries = g_realloc(s->entries, sizeof(entry_t) * len);
-        s->entries[s->entry_count - 1].key = g_strdup(key);
-        s->entries[s->entry_count - 1].value = clean_value(value);
+        /* the first value of a key wins */
+        entry_key lookup = { section, (char *) key };
+        if (g_hash_table_contains(entries, &lookup))
+                return;
+
+        entry_key *k = g_malloc(sizeof(entry_key));
+        k->section = section;
+        k->key = g_strdup(key);
+        g_hash_table_insert(entries, k, clean_value(value));
 }
 
 const char *get_value(const char *section, const char *key)
 {
-        section_t *s = get_section(section);
-        if (!s) {
+        if (!entries)
                 return NULL;
-        }
 
-        for (int i = 0; i < s->entry_count; i++) {
-                if (strcmp(s->entries[i].key, key) == 0) {
-                        return s->entries[i].value;
-                }
-        }
-        return NULL;
+        entry_key lookup = { section, (char *) key };
+        return g_hash_table_lookup(entries, &lookup);
 }
 
 char *ini_get_path(const char *section, const char *key, const char *def)
@@ -159,22 +189,19 @@ bool ini_is_set(const char *ini_section, const char *ini_key)
 
 const char *next_section(const char *section)
 {
-        if (section_count == 0)
+        if (!sections || sections->len == 0)
                 return NULL;
 
         if (section == NULL) {
-                return sections[0].name;
+                return g_ptr_array_index(sections, 0);
         }
 
-        for (int i = 0; i < section_count; i++) {
-                if (strcmp(section, sections[i].name) == 0) {
-                        if (i + 1 >= section_count)
-                                return NULL;
-                        else
-                                return sections[i + 1].name;
-                }
-        }
-        return NULL;
+        /* the index of the next section, as the stored one is off by one */
+        guint next = GPOINTER_TO_UINT(g_hash_table_lookup(section_index, section));
+        if (next == 0 || next >= sections->len)
+                return NULL;
+        else
+                return g_ptr_array_index(sections, next);
 }
 
 int ini_get_bool(const char *section, const char *key, int def)
@@ -302,6 +329,25 @@ void cmdline_load(int argc, char *argv[])
 {
         cmdline_argc = argc;
         cmdline_argv = argv;
+
+        if (cmdline_index) {
+                g_hash_table_destroy(cmdline_index);
+                g_hash_table_destroy(cmdline_aliases);
+        }
+        cmdline_index = g_hash_table_new(g_str_hash, g_str_equal);
+        cmdline_aliases = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+        /* insert backwards, so the first occurrence of an option wins */
+        for (int i = argc - 1; i >= 0; i--)
+                g_hash_table_insert(cmdline_index, argv[i], GINT_TO_POINTER(i + 1));
+}
+
+static int cmdline_index_of(const char *option)
+{
+        if (!cmdline_index)
+                return -1;
+
+        return GPOINTER_TO_INT(g_hash_table_lookup(cmdline_index, option)) - 1;
 }
 
 int cmdline_find_option(const char *key)
@@ -309,34 +355,28 @@ int cmdline_find_option(const char *key)
         if (!key) {
                 return -1;
         }
-        char *key1 = g_strdup(key);
-        char *key2 = strchr(key1, '/');
 
-        if (key2) {
-                *key2 = '\0';
-                key2++;
-        }
+        const char *slash = strchr(key, '/');
+        if (!slash)
+                return cmdline_index_of(key);
 
-        /* look for first key */
-        for (int i = 0; i < cmdline_argc; i++) {
-                if (strcmp(key1, cmdline_argv[i]) == 0) {
-                        g_free(key1);
-                        return i;
-                }
-        }
-
-        /* look for second key if one was specified */
-        if (key2) {
-                for (int i = 0; i < cmdline_argc; i++) {
-                        if (strcmp(key2, cmdline_argv[i]) == 0) {
-                                g_free(key1);
-                                return i;
-                        }
-                }
-        }
+        gpointer cached;
+        if (cmdline_aliases
+            && g_hash_table_lookup_extended(cmdline_aliases, key, NULL, &cached))
+                return GPOINTER_TO_INT(cached);
 
+        /* the first key takes precedence over the second one */
+        char *key1 = g_strndup(key, slash - key);
+        int idx = cmdline_index_of(key1);
         g_free(key1);
-        return -1;
+
+        if (idx < 0)
+                idx = cmdline_index_of(slash + 1);
+
+        if (cmdline_aliases)
+                g_hash_table_insert(cmdline_aliases, g_strdup(key), GINT_TO_POINTER(idx));
+
+        return idx;
 }
 
 static const char *cmdline_get_value(const char *key)
@@ -534,32 +574,30 @@ int option_get_bool(const char *ini_section,
 
 void cmdline_usage_append(const char *key, const char *type, const char *description)
 {
-        char *key_type;
-        if (type && strlen(type) > 0)
-                key_type = g_strdup_printf("%s (%s)", key, type);
-        else
-                key_type = g_strdup(key);
-
         if (!usage_str) {
-                usage_str =
-                    g_strdup_printf("%-40s - %s\n", key_type, description);
-                g_free(key_type);
-                return;
+                usage_str = g_string_new(NULL);
+                usage_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
         }
 
-        char *tmp;
-        tmp =
-            g_strdup_printf("%s%-40s - %s\n", usage_str, key_type, description);
-        g_free(key_type);
+        /* reloading the settings asks for the same options again */
+        if (g_hash_table_contains(usage_keys, key))
+                return;
+        g_hash_table_add(usage_keys, g_strdup(key));
 
-        g_free(usage_str);
-        usage_str = tmp;
+        gsize start = usage_str->len;
+        g_string_append(usage_str, key);
+        if (type && *type)
+                g_string_append_printf(usage_str, " (%s)", type);
 
+        gsize width = usage_str->len - start;
+        if (width < 40)
+                g_string_append_printf(usage_str, "%*s", (int)(40 - width), "");
+        g_string_append_printf(usage_str, " - %s\n", description);
 }
 
 const char *cmdline_create_usage(void)
 {
-        return usage_str;
+        return usage_str ? usage_str->str : NULL;
 }
 
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -7,13 +7,63 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "history_log.h"
 #include "notification.h"
 #include "settings.h"
 
 /* notification lists */
 static GQueue *waiting   = NULL; /* all new notifications get into here */
 static GQueue *displayed = NULL; /* currently displayed notifications */
-static GQueue *history   = NULL; /* history of displayed notifications */
+
+/* history of displayed notifications, compacted and kept in a ring buffer */
+typedef struct _history_item {
+        notification *n;
+        gsize size;             /* memory accounted for n */
+} history_item;
+
+typedef struct _history_ring {
+        history_item *items;
+        unsigned int capacity;
+        unsigned int first;     /* index of the oldest notification */
+        unsigned int length;
+        gsize size;             /* sum of the sizes of all items */
+} history_ring;
+
+static history_ring history = { 0 };
+
+/* position of a notification in either waiting or displayed */
+typedef struct _queue_entry {
+        GQueue *queue;
+        GList *link;
+        gint64 deadline;        /* start + timeout of a displayed notification */
+        int deadline_pos;       /* index in deadlines or -1 */
+} queue_entry;
+
+/* maps notification ids to their queue_entry */
+static GHashTable *entries = NULL;
+
+/* waiting and displayed notifications sharing the same fingerprint */
+typedef struct _duplicate_bucket {
+        guint64 fingerprint;
+        GSList *notifications;
+} duplicate_bucket;
+
+/* maps fingerprints to their duplicate_bucket */
+static GHashTable *duplicates = NULL;
+
+/* The last link of every urgency level in waiting and displayed.
+ * While sorting is enabled, both queues hold one contiguous run of
+ * notifications per urgency level, ordered by id. */
+static GList *waiting_tails[URG_MAX + 1];
+static GList *displayed_tails[URG_MAX + 1];
+
+/* binary min-heap of the queue_entries of displayed notifications
+ * with a timeout, ordered by their deadline */
+static GPtrArray *deadlines = NULL;
+
+/* last time the user was idle. Non-transient notifications
+ * don't time out earlier than their timeout after this point. */
+static gint64 last_idle = 0;
 
 unsigned int displayed_limit = 0;
 int next_notification_id = 1;
@@ -21,11 +71,342 @@ bool pause_displayed = false;
 
 static bool queues_stack_duplicate(notification *n);
 
+static void duplicate_bucket_free(gpointer data)
+{
+        duplicate_bucket *b = data;
+        g_slist_free(b->notifications);
+        g_free(b);
+}
+
+static void queues_duplicates_add(notification *n)
+{
+        duplicate_bucket *b = g_hash_table_lookup(duplicates, &n->fingerprint);
+
+        if (!b) {
+                b = g_malloc0(sizeof(duplicate_bucket));
+                b->fingerprint = n->fingerprint;
+                g_hash_table_insert(duplicates, &b->fingerprint, b);
+        }
+
+        b->notifications = g_slist_prepend(b->notifications, n);
+}
+
+static void queues_duplicates_remove(notification *n)
+{
+        duplicate_bucket *b = g_hash_table_lookup(duplicates, &n->fingerprint);
+        if (!b)
+                return;
+
+        b->notifications = g_slist_remove(b->notifications, n);
+        if (!b->notifications)
+                g_hash_table_remove(duplicates, &n->fingerprint);
+}
+
+static void deadlines_swap(guint i, guint j)
+{
+        queue_entry *a = g_ptr_array_index(deadlines, i);
+        queue_entry *b = g_ptr_array_index(deadlines, j);
+
+        g_ptr_array_index(deadlines, i) = b;
+        g_ptr_array_index(deadlines, j) = a;
+        a->deadline_pos = j;
+        b->deadline_pos = i;
+}
+
+static gint64 deadlines_at(guint i)
+{
+        return ((queue_entry *) g_ptr_array_index(deadlines, i))->deadline;
+}
+
+static void deadlines_sift_up(guint i)
+{
+        while (i > 0 && deadlines_at((i - 1) / 2) > deadlines_at(i)) {
+                deadlines_swap(i, (i - 1) / 2);
+                i = (i - 1) / 2;
+        }
+}
+
+static void deadlines_sift_down(guint i)
+{
+        for (;;) {
+                guint min = i;
+                guint l = 2 * i + 1;
+                guint r = 2 * i + 2;
+
+                if (l < deadlines->len && deadlines_at(l) < deadlines_at(min))
+                        min = l;
+                if (r < deadlines->len && deadlines_at(r) < deadlines_at(min))
+                        min = r;
+                if (min == i)
+                        return;
+
+                deadlines_swap(i, min);
+                i = min;
+        }
+}
+
+static queue_entry *queues_deadline_peek(void)
+{
+        return deadlines->len > 0 ? g_ptr_array_index(deadlines, 0) : NULL;
+}
+
+static void queues_deadline_unset(queue_entry *e)
+{
+        if (e->deadline_pos < 0)
+                return;
+
+        guint pos = e->deadline_pos;
+        guint last = deadlines->len - 1;
+
+        if (pos != last)
+                deadlines_swap(pos, last);
+        g_ptr_array_remove_index(deadlines, last);
+        e->deadline_pos = -1;
+
+        if (pos < deadlines->len) {
+                deadlines_sift_up(pos);
+                deadlines_sift_down(pos);
+        }
+}
+
+/*
+ * (Re-)schedule the timeout of the displayed notification held by e
+ * according to its start and timeout fields.
+ */
+static void queues_deadline_set(queue_entry *e)
+{
+        notification *n = e->link->data;
+
+        queues_deadline_unset(e);
+
+        /* skip hidden and sticky messages */
+        if (n->start == 0 || n->timeout == 0)
+                return;
+
+        e->deadline = n->start + n->timeout;
+        e->deadline_pos = deadlines->len;
+        g_ptr_array_add(deadlines, e);
+        deadlines_sift_up(e->deadline_pos);
+}
+
+static GList **queues_tails(GQueue *queue)
+{
+        return queue == displayed ? displayed_tails : waiting_tails;
+}
+
+static notification *link_notification(GList *link)
+{
+        return link->data;
+}
+
+/*
+ * Insert the detached chain of links first..last (length elements)
+ * after prev. If prev is NULL, the chain becomes the new head.
+ */
+static void queues_splice(GQueue *queue, GList *prev,
+                          GList *first, GList *last, guint length)
+{
+        GList *next = prev ? prev->next : queue->head;
+
+        first->prev = prev;
+        last->next = next;
+
+        if (prev)
+                prev->next = first;
+        else
+                queue->head = first;
+
+        if (next)
+                next->prev = last;
+        else
+                queue->tail = last;
+
+        queue->length += length;
+}
+
+/*
+ * Find the last link of a higher urgency than the given one.
+ */
+static GList *queues_bucket_prev(GList **tails, enum urgency urgency)
+{
+        for (int u = urgency + 1; u <= URG_MAX; u++)
+                if (tails[u])
+                        return tails[u];
+        return NULL;
+}
+
+/*
+ * Insert the detached link into queue. With sorting enabled it goes
+ * after all notifications with a higher urgency or the same urgency
+ * and a lower id, which is the same position g_queue_insert_sorted
+ * with notification_cmp_data would choose. Otherwise it becomes the
+ * new head.
+ */
+static void queues_link_insert(GQueue *queue, GList *link)
+{
+        notification *n = link->data;
+        GList **tails = queues_tails(queue);
+
+        if (!settings.sort) {
+                queues_splice(queue, NULL, link, link, 1);
+                return;
+        }
+
+        /* new ids are the highest ones, so this usually stops at once */
+        GList *prev = tails[n->urgency];
+        while (prev && link_notification(prev)->urgency == n->urgency
+                    && link_notification(prev)->id > n->id)
+                prev = prev->prev;
+
+        if (!tails[n->urgency])
+                prev = queues_bucket_prev(tails, n->urgency);
+
+        queues_splice(queue, prev, link, link, 1);
+
+        if (!tails[n->urgency] || tails[n->urgency] == prev)
+                tails[n->urgency] = link;
+}
+
+/*
+ * Detach link from queue and keep the urgency tails up to date.
+ */
+static void queues_link_unlink(GQueue *queue, GList *link)
+{
+        notification *n = link->data;
+        GList **tails = queues_tails(queue);
+
+        if (tails[n->urgency] == link) {
+                GList *prev = link->prev;
+                if (prev && link_notification(prev)->urgency == n->urgency)
+                        tails[n->urgency] = prev;
+                else
+                        tails[n->urgency] = NULL;
+        }
+
+        g_queue_unlink(queue, link);
+}
+
 void queues_init(void)
 {
-        history   = g_queue_new();
         displayed = g_queue_new();
         waiting   = g_queue_new();
+        entries   = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                          NULL, g_free);
+        duplicates = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                           NULL, duplicate_bucket_free);
+        deadlines = g_ptr_array_new();
+        last_idle = 0;
+
+        memset(waiting_tails, 0, sizeof(waiting_tails));
+        memset(displayed_tails, 0, sizeof(displayed_tails));
+}
+
+/*
+ * Record that the notification in link is now part of queue.
+ * An existing entry for the same id is overwritten.
+ */
+static void queues_entry_set(GQueue *queue, GList *link)
+{
+        notification *n = link->data;
+        queue_entry *e = g_hash_table_lookup(entries, GINT_TO_POINTER(n->id));
+
+        if (!e) {
+                e = g_malloc(sizeof(queue_entry));
+                e->deadline_pos = -1;
+                g_hash_table_insert(entries, GINT_TO_POINTER(n->id), e);
+                queues_duplicates_add(n);
+        }
+
+        e->queue = queue;
+        e->link = link;
+}
+
+static queue_entry *queues_entry_get(int id)
+{
+        return g_hash_table_lookup(entries, GINT_TO_POINTER(id));
+}
+
+/*
+ * Unlink the notification with the given id from its queue
+ * and drop its entry.
+ *
+ * Returns the notification or NULL, if there is none with this id.
+ */
+static notification *queues_entry_take(int id)
+{
+        queue_entry *e = queues_entry_get(id);
+        if (!e)
+                return NULL;
+
+        notification *n = e->link->data;
+        queues_deadline_unset(e);
+        queues_link_unlink(e->queue, e->link);
+        g_list_free_1(e->link);
+        g_hash_table_remove(entries, GINT_TO_POINTER(id));
+        queues_duplicates_remove(n);
+
+        return n;
+}
+
+/*
+ * Insert n into queue at its sorted position and record it.
+ */
+static void queues_insert_sorted(GQueue *queue, notification *n)
+{
+        GList *link = g_list_alloc();
+        link->data = n;
+
+        queues_link_insert(queue, link);
+        queues_entry_set(queue, link);
+}
+
+/*
+ * Put n in place of the notification held by e.
+ * The id of n may differ from the id of the old notification.
+ * If e is displayed, the timeout of n starts now.
+ *
+ * Returns the old notification.
+ */
+static notification *queues_entry_replace(queue_entry *e, notification *n)
+{
+        notification *old = e->link->data;
+
+        /* keep the urgency runs intact */
+        if (settings.sort && old->urgency != n->urgency) {
+                queues_link_unlink(e->queue, e->link);
+                e->link->data = n;
+                queues_link_insert(e->queue, e->link);
+        } else {
+                e->link->data = n;
+        }
+
+        queues_duplicates_remove(old);
+        queues_duplicates_add(n);
+
+        if (old->id != n->id) {
+                g_hash_table_steal(entries, GINT_TO_POINTER(old->id));
+                g_hash_table_insert(entries, GINT_TO_POINTER(n->id), e);
+        }
+
+        if (e->queue == displayed) {
+                n->start = g_get_monotonic_time();
+                queues_deadline_set(e);
+        }
+
+        return old;
+}
+
+/*
+ * Return the next notification id, which is not already
+ * occupied by another notification in the queues.
+ */
+static int queues_next_id(void)
+{
+        do {
+                next_notification_id++;
+        } while (queues_entry_get(next_notification_id));
+
+        return next_notification_id;
 }
 
 void queues_displayed_limit(unsigned int limit)
@@ -48,7 +429,18 @@ unsigned int queues_length_displayed()
 }
 unsigned int queues_length_history()
 {
-        return history->length;
+        return history.length + history_log_length();
+}
+
+gsize queues_history_size(void)
+{
+        return history.size + history_log_size();
+}
+
+notification *queues_get_by_id(int id)
+{
+        queue_entry *e = queues_entry_get(id);
+        return e ? e->link->data : NULL;
 }
 
 int queues_notification_insert(notification *n, int replaces_id)
@@ -73,13 +465,13 @@ int queues_notification_insert(notification *n, int replaces_id)
         }
 
         if (replaces_id == 0) {
-                n->id = ++next_notification_id;
+                n->id = queues_next_id();
                 if (!settings.stack_duplicates || !queues_stack_duplicate(n))
-                        g_queue_insert_sorted(waiting, n, notification_cmp_data, NULL);
+                        queues_insert_sorted(waiting, n);
         } else {
                 n->id = replaces_id;
                 if (!queues_notification_replace_id(n))
-                        g_queue_insert_sorted(waiting, n, notification_cmp_data, NULL);
+                        queues_insert_sorted(waiting, n);
         }
 
         if (settings.print_notifications)
@@ -96,113 +488,65 @@ int queues_notification_insert(notification *n, int replaces_id)
  */
 static bool queues_stack_duplicate(notification *n)
 {
-        for (GList *iter = g_queue_peek_head_link(displayed); iter;
-             iter = iter->next) {
-                notification *orig = iter->data;
-                if (notification_is_duplicate(orig, n)) {
-                        /* If the progress differs, probably notify-send was used to update the notification
-                         * So only count it as a duplicate, if the progress was not the same.
-                         * */
-                        if (orig->progress == n->progress) {
-                                orig->dup_count++;
-                        } else {
-                                orig->progress = n->progress;
-                        }
+        duplicate_bucket *b = g_hash_table_lookup(duplicates, &n->fingerprint);
+        if (!b)
+                return false;
 
-                        iter->data = n;
+        /* prefer a displayed duplicate over a waiting one */
+        queue_entry *e = NULL;
+        for (GSList *iter = b->notifications; iter; iter = iter->next) {
+                notification *orig = iter->data;
+                if (!notification_is_duplicate(orig, n))
+                        continue;
 
-                        n->start = g_get_monotonic_time();
+                e = queues_entry_get(orig->id);
+                if (e->queue == displayed)
+                        break;
+        }
 
-                        n->dup_count = orig->dup_count;
+        if (!e)
+                return false;
 
-                        signal_notification_closed(orig, 1);
+        notification *orig = e->link->data;
 
-                        notification_free(orig);
-                        return true;
-                }
+        /* If the progress differs, probably notify-send was used to update the notification
+         * So only count it as a duplicate, if the progress was not the same.
+         * */
+        if (orig->progress == n->progress) {
+                orig->dup_count++;
+        } else {
+                orig->progress = n->progress;
         }
 
-        for (GList *iter = g_queue_peek_head_link(waiting); iter;
-             iter = iter->next) {
-                notification *orig = iter->data;
-                if (notification_is_duplicate(orig, n)) {
-                        /* If the progress differs, probably notify-send was used to update the notification
-                         * So only count it as a duplicate, if the progress was not the same.
-                         * */
-                        if (orig->progress == n->progress) {
-                                orig->dup_count++;
-                        } else {
-                                orig->progress = n->progress;
-                        }
-                        iter->data = n;
-
-                        n->dup_count = orig->dup_count;
-
-                        signal_notification_closed(orig, 1);
-
-                        notification_free(orig);
-                        return true;
-                }
-        }
+        queues_entry_replace(e, n);
+
+        n->dup_count = orig->dup_count;
 
-        return false;
+        signal_notification_closed(orig, 1);
+
+        notification_free(orig);
+        return true;
 }
 
 bool queues_notification_replace_id(notification *new)
 {
-
-        for (GList *iter = g_queue_peek_head_link(displayed);
-                    iter;
-                    iter = iter->next) {
-                notification *old = iter->data;
-                if (old->id == new->id) {
-                        iter->data = new;
-                        new->start = g_get_monotonic_time();
-                        new->dup_count = old->dup_count;
-                        notification_run_script(new);
-                        notification_free(old);
-                        return true;
-                }
-        }
-
-        for (GList *iter = g_queue_peek_head_link(waiting);
-                    iter;
-                    iter = iter->next) {
-                notification *old = iter->data;
-                if (old->id == new->id) {
-                        iter->data = new;
-                        new->dup_count = old->dup_count;
-                        notification_free(old);
-                        return true;
-                }
-        }
-        return false;
+        queue_entry *e = queues_entry_get(new->id);
+        if (!e)
+                return false;
+
+        bool is_displayed = e->queue == displayed;
+        notification *old = queues_entry_replace(e, new);
+
+        new->dup_count = old->dup_count;
+        if (is_displayed)
+                notification_run_script(new);
+        notification_free(old);
+        return true;
 }
 
 int queues_notification_close_id(int id, enum reason reason)
 {
-        notification *target = NULL;
-
-        for (GList *iter = g_queue_peek_head_link(displayed); iter;
-             iter = iter->next) {
-                notification *n = iter->data;
-                if (n->id == id) {
-                        g_queue_remove(displayed, n);
-                        target = n;
-                        break;
-                }
-        }
-
-        for (GList *iter = g_queue_peek_head_link(waiting); iter;
-             iter = iter->next) {
-                notification *n = iter->data;
-                if (n->id == id) {
-                        assert(target == NULL);
-                        g_queue_remove(waiting, n);
-                        target = n;
-                        break;
-                }
-        }
+        notification *target = queues_entry_take(id);
 
         if (target) {
                 //Don't notify clients if notification was pulled from history
@@ -220,30 +564,132 @@ int queues_notification_close(notification *n, enum reason reason)
         return queues_notification_close_id(n->id, reason);
 }
 
+/*
+ * Return the slot of the i-th oldest notification in history
+ */
+static history_item *queues_history_at(unsigned int i)
+{
+        return &history.items[(history.first + i) % history.capacity];
+}
+
+static void queues_history_free_oldest(void)
+{
+        history_item *oldest = queues_history_at(0);
+
+        /* the persisted notifications are even older, so they go first */
+        history_log_drop(history_log_length() + 1);
+
+        history.size -= oldest->size;
+        notification_free(oldest->n);
+
+        history.first = (history.first + 1) % history.capacity;
+        history.length--;
+}
+
+/*
+ * Reallocate history to hold capacity notifications,
+ * dropping the oldest ones which don't fit anymore.
+ */
+static void queues_history_resize(unsigned int capacity)
+{
+        while (history.length > capacity)
+                queues_history_free_oldest();
+
+        history_item *items = g_new(history_item, capacity);
+        for (unsigned int i = 0; i < history.length; i++)
+                items[i] = *queues_history_at(i);
+
+        g_free(history.items);
+        history.items = items;
+        history.capacity = capacity;
+        history.first = 0;
+}
+
 void queues_history_pop(void)
 {
-        if (g_queue_is_empty(history))
-                return;
+        notification *n;
+
+        if (history.length > 0) {
+                history_item *newest = queues_history_at(history.length - 1);
+                n = newest->n;
+                history.size -= newest->size;
+                history.length--;
+        } else {
+                /* all newer notifications are gone, continue with the
+                 * ones persisted by a previous run */
+                n = history_log_take();
+                if (!n)
+                        return;
+        }
 
-        notification *n = g_queue_pop_tail(history);
+        history_log_pop();
+
+        notification_format_message(n);
         n->redisplayed = true;
         n->start = 0;
         n->timeout = settings.sticky_history ? 0 : n->timeout;
-        g_queue_push_head(waiting, n);
+
+        /* the id may have been handed out again in the meantime */
+        if (n->id == 0 || queues_entry_get(n->id))
+                n->id = queues_next_id();
+
+        /* the settings may have changed since it went to history or,
+         * for a persisted one, since the previous run */
+        n->fingerprint = notification_fingerprint(n);
+
+        queues_insert_sorted(waiting, n);
 }
 
 void queues_history_push(notification *n)
 {
-        if (!n->history_ignore) {
-                if (settings.history_length > 0 && history->length >= settings.history_length) {
-                        notification *to_free = g_queue_pop_head(history);
-                        notification_free(to_free);
-                }
-
-                g_queue_push_tail(history, n);
-        } else {
+        if (n->history_ignore) {
                 notification_free(n);
+                return;
         }
+
+        if (settings.history_length > 0) {
+                if (history.capacity != (unsigned int) settings.history_length)
+                        queues_history_resize(settings.history_length);
+        } else if (history.length == history.capacity) {
+                queues_history_resize(MAX(16, history.capacity * 2));
+        }
+
+        notification_compact(n);
+
+        if (history.length == history.capacity)
+                queues_history_free_oldest();
+
+        history_item *item = queues_history_at(history.length);
+        item->n = n;
+        item->size = notification_size(n);
+        history.size += item->size;
+        history.length++;
+
+        queues_history_trim();
+
+        /* n is gone already, if it doesn't fit into history_memory on
+         * its own. Logging it anyway would make a later pop record
+         * cancel it instead of the notification actually popped. */
+        if (history.length > 0)
+                history_log_push(n);
+
+        /* the persisted notifications are older than all in memory */
+        if (settings.history_length > 0)
+                history_log_trim(settings.history_length - history.length);
+}
+
+void queues_history_trim(void)
+{
+        if (settings.history_memory <= 0)
+                return;
+
+        gsize memory = settings.history_memory;
+
+        /* the persisted notifications are older than all in memory */
+        history_log_trim_size(history.size < memory ? memory - history.size : 0);
+
+        while (history.length > 0 && history.size > memory)
+                queues_history_free_oldest();
 }
 
 void queues_history_push_all(void)
@@ -259,35 +705,87 @@ void queues_history_push_all(void)
 
 void queues_check_timeouts(bool idle)
 {
-        /* nothing to do */
-        if (displayed->length == 0)
-                return;
+        gint64 now = g_get_monotonic_time();
 
-        GList *iter = g_queue_peek_head_link(displayed);
-        while (iter) {
-                notification *n = iter->data;
+        /* don't timeout when user is idle */
+        if (idle)
+                last_idle = now;
 
-                /*
-                 * Update iter to the next item before we either exit the
-                 * current iteration of the loop or potentially delete the
-                 * notification which would invalidate the pointer.
-                 */
-                iter = iter->next;
+        queue_entry *e;
+        while ((e = queues_deadline_peek()) && e->deadline < now) {
+                notification *n = e->link->data;
 
-                /* don't timeout when user is idle */
-                if (idle && !n->transient) {
-                        n->start = g_get_monotonic_time();
+                /* the user has been idle since the notification's
+                 * timeout started, so restart it from then on */
+                if (!n->transient && n->start < last_idle) {
+                        n->start = last_idle;
+                        queues_deadline_set(e);
                         continue;
                 }
 
-                /* skip hidden and sticky messages */
-                if (n->start == 0 || n->timeout == 0) {
+                /* remove old message */
+                queues_notification_close(n, REASON_TIME);
+        }
+}
+
+/*
+ * Move all displayed notifications back to waiting.
+ *
+ * The displayed notifications usually have lower ids than the waiting
+ * ones of the same urgency, so each urgency run gets spliced into
+ * waiting as a whole and only falls back to inserting one by one
+ * when the ids interleave.
+ */
+static void queues_move_displayed_to_waiting(void)
+{
+        GList *head = g_queue_peek_head_link(displayed);
+        guint lengths[URG_MAX + 1] = { 0 };
+        GList *tails[URG_MAX + 1];
+
+        for (GList *iter = head; iter; iter = iter->next) {
+                queue_entry *e = queues_entry_get(link_notification(iter)->id);
+                e->queue = waiting;
+                e->deadline_pos = -1;
+                lengths[link_notification(iter)->urgency]++;
+        }
+        g_ptr_array_set_size(deadlines, 0);
+
+        memcpy(tails, displayed_tails, sizeof(tails));
+        memset(displayed_tails, 0, sizeof(displayed_tails));
+        g_queue_init(displayed);
+
+        if (!settings.sort) {
+                while (head) {
+                        GList *link = head;
+                        head = head->next;
+                        queues_splice(waiting, NULL, link, link, 1);
+                }
+                return;
+        }
+
+        for (int u = URG_MAX; u >= URG_MIN; u--) {
+                if (!tails[u])
+                        continue;
+
+                GList *last = tails[u];
+                GList *first = head;
+                head = last->next;
+                last->next = NULL;
+
+                GList *prev = queues_bucket_prev(waiting_tails, u);
+                GList *next = prev ? prev->next : g_queue_peek_head_link(waiting);
+
+                if (!waiting_tails[u] || link_notification(last)->id < link_notification(next)->id) {
+                        queues_splice(waiting, prev, first, last, lengths[u]);
+                        if (!waiting_tails[u])
+                                waiting_tails[u] = last;
                         continue;
                 }
 
-                /* remove old message */
-                if (g_get_monotonic_time() - n->start > n->timeout) {
-                        queues_notification_close(n, REASON_TIME);
+                while (first) {
+                        GList *link = first;
+                        first = first->next;
+                        queues_link_insert(waiting, link);
                 }
         }
 }
@@ -295,10 +793,7 @@ void queues_check_timeouts(bool idle)
 void queues_update()
 {
         if (pause_displayed) {
-                while (displayed->length > 0) {
-                        g_queue_insert_sorted(
-                            waiting, g_queue_pop_head(displayed), notification_cmp_data, NULL);
-                }
+                queues_move_displayed_to_waiting();
                 return;
         }
 
@@ -310,10 +805,10 @@ void queues_update()
                         break;
                 }
 
-                notification *n = g_queue_pop_head(waiting);
-
-                if (!n)
-                        return;
+                GList *link = g_queue_peek_head_link(waiting);
+                notification *n = link->data;
+                queues_link_unlink(waiting, link);
+                g_list_free_1(link);
 
                 n->start = g_get_monotonic_time();
 
@@ -321,7 +816,8 @@ void queues_update()
                         notification_run_script(n);
                 }
 
-                g_queue_insert_sorted(displayed, n, notification_cmp_data, NULL);
+                queues_insert_sorted(displayed, n);
+                queues_deadline_set(queues_entry_get(n->id));
         }
 }
 
@@ -329,20 +825,21 @@ gint64 queues_get_next_datachange(gint64 time)
 {
         gint64 sleep = G_MAXINT64;
 
-        for (GList *iter = g_queue_peek_head_link(displayed); iter;
-                        iter = iter->next) {
-                notification *n = iter->data;
-                gint64 ttl = n->timeout - (time - n->start);
-
-                if (n->timeout > 0) {
-                        if (ttl > 0)
-                                sleep = MIN(sleep, ttl);
-                        else
-                                // while we're processing, the notification already timed out
-                                return 0;
-                }
+        queue_entry *e = queues_deadline_peek();
+        if (e) {
+                gint64 ttl = e->deadline - time;
+                if (ttl > 0)
+                        sleep = ttl;
+                else
+                        // while we're processing, the notification already timed out
+                        return 0;
+        }
 
-                if (settings.show_age_threshold >= 0) {
+        if (settings.show_age_threshold >= 0) {
+                for (GList *iter = g_queue_peek_head_link(displayed); iter;
+                                iter = iter->next) {
+                        notification *n = iter->data;
+                        gint64 ttl = n->timeout - (time - n->start);
                         gint64 age = time - n->timestamp;
 
                         if (age > settings.show_age_threshold)
@@ -356,6 +853,57 @@ gint64 queues_get_next_datachange(gint64 time)
         return sleep != G_MAXINT64 ? sleep : -1;
 }
 
+static gint queues_link_cmp_id(gconstpointer a, gconstpointer b)
+{
+        const notification *na = link_notification(*(GList **) a);
+        const notification *nb = link_notification(*(GList **) b);
+
+        return na->id - nb->id;
+}
+
+/*
+ * Insert all links of queue again, ordered by their ids. With sorting
+ * enabled, every link goes right behind the last one of its urgency,
+ * otherwise the newest notification ends up at the head.
+ */
+static void queues_reinsert(GQueue *queue)
+{
+        GPtrArray *links = g_ptr_array_sized_new(queue->length);
+
+        for (GList *iter = g_queue_peek_head_link(queue); iter; iter = iter->next)
+                g_ptr_array_add(links, iter);
+        g_ptr_array_sort(links, queues_link_cmp_id);
+
+        memset(queues_tails(queue), 0, sizeof(waiting_tails));
+        g_queue_init(queue);
+
+        for (guint i = 0; i < links->len; i++)
+                queues_link_insert(queue, g_ptr_array_index(links, i));
+
+        g_ptr_array_free(links, true);
+}
+
+void queues_resort(void)
+{
+        queues_reinsert(waiting);
+        queues_reinsert(displayed);
+}
+
+void queues_update_fingerprints(void)
+{
+        GQueue *queues[] = { waiting, displayed };
+
+        for (int i = 0; i < G_N_ELEMENTS(queues); i++) {
+                for (GList *iter = g_queue_peek_head_link(queues[i]); iter; iter = iter->next) {
+                        notification *n = iter->data;
+
+                        queues_duplicates_remove(n);
+                        n->fingerprint = notification_fingerprint(n);
+                        queues_duplicates_add(n);
+                }
+        }
+}
+
 void queues_pause_on(void)
 {
         pause_displayed = true;
@@ -379,7 +927,18 @@ static void teardown_notification(gpointer data)
 
 void teardown_queues(void)
 {
-        g_queue_free_full(history, teardown_notification);
+        g_ptr_array_free(deadlines, true);
+        deadlines = NULL;
+        g_hash_table_destroy(duplicates);
+        duplicates = NULL;
+        g_hash_table_destroy(entries);
+        entries = NULL;
+
+        for (unsigned int i = 0; i < history.length; i++)
+                notification_free(queues_history_at(i)->n);
+        g_free(history.items);
+        history = (history_ring) { 0 };
+
         g_queue_free_full(displayed, teardown_notification);
         g_queue_free_full(waiting, teardown_notification);
 }
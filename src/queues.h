@@ -30,6 +30,18 @@ unsigned int queues_length_waiting();
 unsigned int queues_length_displayed();
 unsigned int queues_length_history();
 
+/*
+ * Returns the amount of memory in bytes accounted
+ * for the notifications in history
+ */
+gsize queues_history_size(void);
+
+/*
+ * Return the waiting or displayed notification with the given id
+ * or NULL, if there is none.
+ */
+notification *queues_get_by_id(int id);
+
 /*
  * Insert a fully initialized notification into queues
  * Respects stack_duplicates, and notification replacement
@@ -83,6 +95,12 @@ void queues_history_pop(void);
  */
 void queues_history_push(notification *n);
 
+/*
+ * Delete the oldest notifications in history, including the persisted
+ * ones, until history fits into history_memory again
+ */
+void queues_history_trim(void);
+
 /*
  * Push all waiting and displayed notifications to history
  */
@@ -112,6 +130,18 @@ void queues_update();
  */
 gint64 queues_get_next_datachange(gint64 time);
 
+/*
+ * Restore the order of the waiting and displayed notifications after
+ * sorting has been switched on or off.
+ */
+void queues_resort(void);
+
+/*
+ * Recompute the fingerprints of the waiting and displayed
+ * notifications after settings they depend on have changed.
+ */
+void queues_update_fingerprints(void);
+
 /*
  * Pause queue-management of dunst
  *   pause_on  = paused (no notifications displayed)
@@ -0,0 +1,335 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#include "rawimage.h"
+
+#include <glib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+
+/* interned images, each one is its own key */
+static GHashTable *interned = NULL;
+static guint64 next_id = 1;
+
+void rawimage_free(RawImage *i)
+{
+        if (!i)
+                return;
+
+        if (i->refcount > 1) {
+                i->refcount--;
+                return;
+        }
+        if (i->id)
+                g_hash_table_remove(interned, i);
+
+        if (i->variant)
+                g_variant_unref(i->variant);
+        else
+                g_free(i->data);
+        g_free(i);
+}
+
+void rawimage_detach(RawImage *i)
+{
+        if (!i->variant)
+                return;
+
+        gsize size = rawimage_data_size(i);
+        unsigned char *data = g_malloc(size);
+        memcpy(data, i->data, size);
+
+        g_variant_unref(i->variant);
+        i->variant = NULL;
+        i->data = data;
+}
+
+bool rawimage_equal(const RawImage *a, const RawImage *b)
+{
+        if (a == b)
+                return true;
+        if (!a || !b)
+                return false;
+
+        return a->width == b->width
+            && a->height == b->height
+            && a->rowstride == b->rowstride
+            && a->has_alpha == b->has_alpha
+            && a->bits_per_sample == b->bits_per_sample
+            && a->n_channels == b->n_channels
+            && memcmp(a->data, b->data, rawimage_data_size(a)) == 0;
+}
+
+static guint rawimage_hash(gconstpointer data)
+{
+        return ((const RawImage *) data)->hash;
+}
+
+static gboolean rawimage_key_equal(gconstpointer a, gconstpointer b)
+{
+        return rawimage_equal(a, b);
+}
+
+RawImage *rawimage_intern(RawImage *i)
+{
+        if (!i || i->id)
+                return i;
+
+        int dims[] = {
+                i->width, i->height, i->rowstride,
+                i->has_alpha, i->bits_per_sample, i->n_channels
+        };
+        i->hash = hash_data(dims, sizeof(dims), 0);
+        i->hash = hash_data(i->data, rawimage_data_size(i), i->hash);
+
+        if (!interned)
+                interned = g_hash_table_new(rawimage_hash, rawimage_key_equal);
+
+        RawImage *shared = g_hash_table_lookup(interned, i);
+        if (shared) {
+                shared->refcount++;
+                rawimage_free(i);
+                return shared;
+        }
+
+        i->refcount = 1;
+        i->id = next_id++;
+        g_hash_table_add(interned, i);
+        return i;
+}
+
+gsize rawimage_data_size(const RawImage *i)
+{
+        return (gsize) (i->height - 1) * i->rowstride + i->width
+                * ((i->n_channels * i->bits_per_sample + 7) / 8);
+}
+
+RawImage *rawimage_scale_down(const RawImage *i, int size)
+{
+        if (size <= 0 || i->bits_per_sample != 8 || i->n_channels < 1 || i->n_channels > 4
+            || MAX(i->width, i->height) <= size)
+                return NULL;
+
+        int alpha = i->has_alpha ? i->n_channels - 1 : -1;
+
+        RawImage *s = g_malloc(sizeof(RawImage));
+        *s = *i;
+        s->variant = NULL;
+        s->refcount = 0;
+        s->id = 0;
+        rawimage_scaled_size(i, size, &s->width, &s->height);
+        s->rowstride = s->width * s->n_channels;
+        s->data = g_malloc((gsize) s->rowstride * s->height);
+
+        /* average over the box of source pixels covered by each target
+         * pixel, weighting the colors by their alpha */
+        for (int y = 0; y < s->height; y++) {
+                int y0 = (gint64) y * i->height / s->height;
+                int y1 = MAX(y0 + 1, (gint64) (y + 1) * i->height / s->height);
+
+                for (int x = 0; x < s->width; x++) {
+                        int x0 = (gint64) x * i->width / s->width;
+                        int x1 = MAX(x0 + 1, (gint64) (x + 1) * i->width / s->width);
+                        guint64 sums[4] = { 0 };
+                        guint64 weight = 0;
+                        guint64 count = (guint64) (y1 - y0) * (x1 - x0);
+
+                        for (int sy = y0; sy < y1; sy++) {
+                                const unsigned char *p = i->data
+                                        + (gsize) sy * i->rowstride
+                                        + (gsize) x0 * i->n_channels;
+
+                                for (int sx = x0; sx < x1; sx++, p += i->n_channels) {
+                                        guint64 a = alpha >= 0 ? p[alpha] : 255;
+                                        for (int c = 0; c < i->n_channels; c++)
+                                                sums[c] += c == alpha ? p[c] : p[c] * a;
+                                        weight += a;
+                                }
+                        }
+
+                        unsigned char *q = s->data
+                                + (gsize) y * s->rowstride
+                                + (gsize) x * s->n_channels;
+                        for (int c = 0; c < s->n_channels; c++) {
+                                if (c == alpha)
+                                        q[c] = sums[c] / count;
+                                else
+                                        q[c] = weight ? sums[c] / weight : 0;
+                        }
+                }
+        }
+
+        return s;
+}
+
+void rawimage_scaled_size(const RawImage *i, int size, int *width, int *height)
+{
+        if (size <= 0 || MAX(i->width, i->height) <= size) {
+                *width = i->width;
+                *height = i->height;
+        } else if (i->width >= i->height) {
+                *width = size;
+                *height = MAX(1, (int) ((double) size / i->width * i->height));
+        } else {
+                *width = MAX(1, (int) ((double) size / i->height * i->width));
+                *height = size;
+        }
+}
+
+/* v / 255, rounded, for v up to 255 * 255 */
+static inline guint32 div255(guint32 v)
+{
+        v += 128;
+        return (v + (v >> 8)) >> 8;
+}
+
+static inline guint32 argb32(guint32 a, guint32 r, guint32 g, guint32 b)
+{
+        return a << 24 | r << 16 | g << 8 | b;
+}
+
+#ifdef __SSE2__
+/*
+ * Premultiply 2 RGBA pixels, which have been widened to 16 bits per
+ * channel, and reorder them to BGRA, the byte order of ARGB32 on
+ * little endian.
+ */
+static inline __m128i premultiply_sse2(__m128i px)
+{
+        /* the alpha channel gets multiplied by 255 to keep it */
+        const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        const __m128i alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+        __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm_or_si128(_mm_and_si128(a, color_mask), alpha_255);
+
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), _mm_set1_epi16(128));
+        t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        t = _mm_shufflelo_epi16(t, _MM_SHUFFLE(3, 0, 1, 2));
+        return _mm_shufflehi_epi16(t, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+/*
+ * Convert the RGBA pixels of a row 4 at a time.
+ *
+ * Returns the amount of pixels converted.
+ */
+static int convert_row_rgba_sse2(const unsigned char *src, guint32 *dst, int width)
+{
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+
+        for (; x + 4 <= width; x += 4) {
+                __m128i px = _mm_loadu_si128((const __m128i *) (src + 4 * x));
+                __m128i lo = premultiply_sse2(_mm_unpacklo_epi8(px, zero));
+                __m128i hi = premultiply_sse2(_mm_unpackhi_epi8(px, zero));
+                _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(lo, hi));
+        }
+
+        return x;
+}
+#endif
+
+static void convert_row(const unsigned char *src, guint32 *dst, int width,
+                        int n_channels, bool alpha)
+{
+        int x = 0;
+
+#ifdef __SSE2__
+        if (alpha && n_channels == 4)
+                x = convert_row_rgba_sse2(src, dst, width);
+#endif
+
+        src += x * n_channels;
+        if (!alpha) {
+                for (; x < width; x++, src += n_channels)
+                        dst[x] = argb32(255, src[0], src[1], src[2]);
+                return;
+        }
+
+        for (; x < width; x++, src += n_channels)
+                dst[x] = argb32(src[3], div255(src[0] * src[3]),
+                                div255(src[1] * src[3]), div255(src[2] * src[3]));
+}
+
+/*
+ * Convert and scale down i by averaging over the box of source pixels
+ * covered by each target pixel. Averaging the premultiplied colors
+ * weights them by their alpha.
+ */
+static void convert_scaled(const RawImage *i, int width, int height,
+                           guint32 *dst, int stride, bool alpha)
+{
+        int *x0 = g_new(int, 2 * width);
+        int *x1 = x0 + width;
+
+        for (int x = 0; x < width; x++) {
+                x0[x] = (gint64) x * i->width / width;
+                x1[x] = MAX(x0[x] + 1, (gint64) (x + 1) * i->width / width);
+        }
+
+        for (int y = 0; y < height; y++) {
+                int y0 = (gint64) y * i->height / height;
+                int y1 = MAX(y0 + 1, (gint64) (y + 1) * i->height / height);
+                guint32 *row = (guint32 *) ((unsigned char *) dst + (gsize) y * stride);
+
+                for (int x = 0; x < width; x++) {
+                        guint64 r = 0, g = 0, b = 0, a = 0;
+
+                        for (int sy = y0; sy < y1; sy++) {
+                                const unsigned char *p = i->data
+                                        + (gsize) sy * i->rowstride
+                                        + (gsize) x0[x] * i->n_channels;
+
+                                for (int sx = x0[x]; sx < x1[x]; sx++, p += i->n_channels) {
+                                        guint32 pa = alpha ? p[3] : 255;
+                                        r += p[0] * pa;
+                                        g += p[1] * pa;
+                                        b += p[2] * pa;
+                                        a += pa;
+                                }
+                        }
+
+                        guint64 count = (guint64) (y1 - y0) * (x1[x] - x0[x]);
+                        guint64 div = count * 255;
+                        guint32 pa = (a + count / 2) / count;
+                        row[x] = argb32(pa,
+                                        MIN(pa, (r + div / 2) / div),
+                                        MIN(pa, (g + div / 2) / div),
+                                        MIN(pa, (b + div / 2) / div));
+                }
+        }
+
+        g_free(x0);
+}
+
+bool rawimage_to_argb32(const RawImage *i, int width, int height,
+                        guint32 *dst, int stride)
+{
+        if (i->bits_per_sample != 8 || i->n_channels < 3 || i->n_channels > 4
+            || i->width <= 0 || i->height <= 0
+            || (gint64) i->rowstride < (gint64) i->width * i->n_channels
+            || width <= 0 || height <= 0 || width > i->width || height > i->height)
+                return false;
+
+        bool alpha = i->has_alpha && i->n_channels == 4;
+
+        if (width < i->width || height < i->height) {
+                convert_scaled(i, width, height, dst, stride, alpha);
+                return true;
+        }
+
+        for (int y = 0; y < height; y++)
+                convert_row(i->data + (gsize) y * i->rowstride,
+                            (guint32 *) ((unsigned char *) dst + (gsize) y * stride),
+                            width, i->n_channels, alpha);
+
+        return true;
+}
+
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,90 @@
+/* copyright 2013 Sascha Kruse and contributors (see LICENSE for licensing information) */
+#ifndef DUNST_RAWIMAGE_H
+#define DUNST_RAWIMAGE_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/* pixel data as sent in the image-data hint */
+typedef struct _raw_image {
+        int width;
+        int height;
+        int rowstride;
+        int has_alpha;
+        int bits_per_sample;
+        int n_channels;
+        unsigned char *data;
+        /* (nullable): the variant data points into, instead of owning it */
+        GVariant *variant;
+
+        /* set by rawimage_intern */
+        int refcount;
+        guint64 id;             /* unique for every interned image */
+        guint64 hash;
+} RawImage;
+
+/*
+ * Free a #RawImage or drop a reference to it, if it's interned and
+ * still used elsewhere.
+ * @i: (nullable): pointer to #RawImage
+ */
+void rawimage_free(RawImage *i);
+
+/*
+ * Share i with all other interned images of the same content.
+ * Takes over i, which gets freed if an identical image has been
+ * interned already.
+ *
+ * Returns the interned image, which has to be released with
+ * rawimage_free and must not be changed.
+ */
+RawImage *rawimage_intern(RawImage *i);
+
+/*
+ * Copy the pixels out of the variant i->data points into, so that i
+ * doesn't keep the whole D-Bus message alive anymore. The content of i
+ * stays the same, so interned images can be detached, too.
+ */
+void rawimage_detach(RawImage *i);
+
+/*
+ * Compare the size, format and content of two images.
+ * @a: (nullable)
+ * @b: (nullable)
+ */
+bool rawimage_equal(const RawImage *a, const RawImage *b);
+
+/*
+ * Return the amount of bytes in i->data
+ */
+gsize rawimage_data_size(const RawImage *i);
+
+/*
+ * Scale i down, so that its larger axis is size pixels long.
+ * Only images with 8 bits per sample and up to 4 channels can be scaled.
+ *
+ * Returns a newly allocated #RawImage or NULL, if i is already
+ * small enough or can't be scaled.
+ */
+RawImage *rawimage_scale_down(const RawImage *i, int size);
+
+/*
+ * Get the size of i, once its larger axis got scaled down to size
+ * pixels. A size of 0 keeps the size of i.
+ */
+void rawimage_scaled_size(const RawImage *i, int size, int *width, int *height);
+
+/*
+ * Convert i to premultiplied ARGB32 pixels in native byte order, which
+ * is the layout of CAIRO_FORMAT_ARGB32, and scale it down to width and
+ * height on the way. Only 8 bit RGB and RGBA images can be converted.
+ *
+ * @dst: the target pixels, which are stride bytes apart per row
+ *
+ * Returns false, if i can't be converted.
+ */
+bool rawimage_to_argb32(const RawImage *i, int width, int height,
+                        guint32 *dst, int stride);
+
+#endif
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
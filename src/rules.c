@@ -4,8 +4,81 @@
 
 #include <fnmatch.h>
 #include <glib.h>
+#include <string.h>
 
 #include "dunst.h"
+#include "utils.h"
+
+enum pattern_type {
+        PATTERN_NONE,           /* the field is not filtered */
+        PATTERN_LITERAL,        /* "foo" */
+        PATTERN_PREFIX,         /* "foo*" */
+        PATTERN_SUFFIX,         /* "*foo" */
+        PATTERN_SUBSTRING,      /* "*foo*" */
+        PATTERN_ANY,            /* "*" */
+        PATTERN_GLOB,           /* anything else, matched with fnmatch */
+        PATTERN_REGEX,          /* regular expressions and caseless globs */
+};
+
+struct compiled_regex {
+        GRegex *regex;          /* NULL, if the expression is invalid */
+        char *literal;          /* a string contained in all matches, lowercase if caseless */
+        size_t len;
+        bool caseless;
+};
+
+struct pattern {
+        enum pattern_type type;
+        const char *glob;
+        char *literal;          /* the glob without its leading and trailing stars */
+        size_t len;
+        const struct compiled_regex *regex;
+};
+
+struct rule_matcher {
+        rule_t *rule;
+        struct pattern appname;
+        struct pattern summary;
+        struct pattern body;
+        struct pattern icon;
+        struct pattern category;
+};
+
+/* the compiled rules in the order of the rules list */
+static GArray *matchers = NULL;
+/* literal appname filter -> GArray of matcher indices */
+static GHashTable *by_appname = NULL;
+/* literal category filter of rules not in by_appname -> GArray of matcher indices */
+static GHashTable *by_category = NULL;
+/* indices of all other matchers */
+static GArray *unindexed = NULL;
+
+/*
+ * match mode and expression -> struct compiled_regex, kept until the
+ * rules get compiled again without them
+ */
+static GHashTable *regex_cache = NULL;
+/* the expressions of the previous rules, while compiling new ones */
+static GHashTable *stale_regex_cache = NULL;
+
+/*
+ * The merged effect of the matching rules for notifications, whose
+ * outcome only depends on these attributes.
+ */
+struct rule_cache_key {
+        char *appname;
+        char *category;
+        enum urgency urgency;
+        bool transient;
+};
+
+/* the most tuples to remember, before starting over */
+#define RULE_CACHE_MAX 1024
+
+/* struct rule_cache_key -> merged rule_t */
+static GHashTable *rule_cache = NULL;
+static guint64 rule_cache_hits = 0;
+static guint64 rule_cache_misses = 0;
 
 /*
  * Apply rule to notification.
@@ -39,16 +112,776 @@ void rule_apply(rule_t *r, notification *n)
 }
 
 /*
- * Check all rules if they match n and apply.
+ * Find the end of the bracket expression starting at p in a glob.
+ *
+ * Returns a pointer to the closing bracket or NULL, if there is none.
  */
-void rule_apply_all(notification *n)
+static const char *glob_class_end(const char *p)
+{
+        p++;
+        if (*p == '!' || *p == '^')
+                p++;
+        if (*p == ']')
+                p++;
+
+        while (*p && *p != ']') {
+                if (*p == '[' && p[1] && strchr(":.=", p[1])) {
+                        /* character classes like [:alpha:] */
+                        const char *end = p + 2;
+                        while (*end && !(end[0] == p[1] && end[1] == ']'))
+                                end++;
+                        if (*end) {
+                                p = end + 2;
+                                continue;
+                        }
+                }
+                if (*p == '\\' && p[1])
+                        p++;
+                p++;
+        }
+
+        return *p ? p : NULL;
+}
+
+static void regex_append_literal(string_builder *b, char c)
+{
+        if ((guchar) c < 0x80 && !g_ascii_isalnum(c))
+                string_builder_append(b, "\\", 1);
+        string_builder_append(b, &c, 1);
+}
+
+/*
+ * Translate a shell-like glob into an anchored regular expression
+ * matching the same strings, when compiled with G_REGEX_DOTALL.
+ */
+static char *glob_to_regex(const char *glob)
+{
+        string_builder *b = string_builder_new(strlen(glob) * 2 + 4);
+
+        string_builder_append(b, "\\A", -1);
+        for (const char *p = glob; *p; p++) {
+                const char *end;
+
+                switch (*p) {
+                case '*':
+                        string_builder_append(b, ".*", -1);
+                        break;
+                case '?':
+                        string_builder_append(b, ".", -1);
+                        break;
+                case '\\':
+                        if (!p[1]) {
+                                /* like fnmatch, never match a trailing backslash */
+                                string_builder_append(b, "(*FAIL)", -1);
+                                break;
+                        }
+                        p++;
+                        regex_append_literal(b, *p);
+                        break;
+                case '[':
+                        end = glob_class_end(p);
+                        if (!end) {
+                                regex_append_literal(b, *p);
+                                break;
+                        }
+                        string_builder_append(b, "[", 1);
+                        p++;
+                        if (*p == '!' || *p == '^') {
+                                string_builder_append(b, "^", 1);
+                                p++;
+                        }
+                        string_builder_append(b, p, end + 1 - p);
+                        p = end;
+                        break;
+                default:
+                        regex_append_literal(b, *p);
+                        break;
+                }
+        }
+        string_builder_append(b, "\\z", -1);
+
+        return string_builder_steal(b);
+}
+
+/*
+ * Skip the bracket expression starting at p in a regular expression.
+ *
+ * Returns a pointer behind it or NULL, if it is not terminated.
+ */
+static const char *regex_skip_class(const char *p)
+{
+        p++;
+        if (*p == '^')
+                p++;
+        if (*p == ']')
+                p++;
+
+        while (*p != ']') {
+                if (!*p)
+                        return NULL;
+                if (*p == '[' && p[1] && strchr(":.=", p[1])) {
+                        const char *end = p + 2;
+                        while (*end && !(end[0] == p[1] && end[1] == ']'))
+                                end++;
+                        if (*end) {
+                                p = end + 2;
+                                continue;
+                        }
+                }
+                if (*p == '\\' && !*++p)
+                        return NULL;
+                p++;
+        }
+
+        return p + 1;
+}
+
+/*
+ * Skip the group starting at p in a regular expression.
+ *
+ * Returns a pointer behind it or NULL, if it is not terminated.
+ */
+static const char *regex_skip_group(const char *p)
+{
+        int depth = 0;
+
+        while (*p) {
+                switch (*p) {
+                case '(':
+                        depth++;
+                        break;
+                case ')':
+                        if (--depth == 0)
+                                return p + 1;
+                        break;
+                case '[':
+                        p = regex_skip_class(p);
+                        if (!p)
+                                return NULL;
+                        continue;
+                case '\\':
+                        if (!*++p)
+                                return NULL;
+                        break;
+                }
+                p++;
+        }
+
+        return NULL;
+}
+
+static void regex_literal_end(GString *best, GString *run)
 {
+        if (run->len > best->len)
+                g_string_assign(best, run->str);
+        g_string_truncate(run, 0);
+}
+
+/*
+ * Find the longest string, which is contained in every match of the
+ * regular expression re. With caseless set, the string is lowercase
+ * and has to be searched for ignoring the case of ASCII letters.
+ *
+ * Constructs, which are not understood, end the string or make it
+ * give up, so it may be shorter than it could be, but never wrong.
+ *
+ * Returns the string or NULL, if none was found.
+ */
+static char *regex_required_literal(const char *re, bool caseless, size_t *len)
+{
+        /* inline options may change the meaning of everything behind them */
+        if (strstr(re, "(?")) {
+                *len = 0;
+                return NULL;
+        }
+
+        GString *best = g_string_new(NULL);
+        GString *run = g_string_new(NULL);
+        /* the start of the last atom in run or -1, if it is not in run */
+        gssize atom = -1;
+        const char *p = re;
+
+        while (*p) {
+                switch (*p) {
+                case '|':
+                        /* alternatives on the top level, anything is optional */
+                        goto fail;
+                case '*':
+                case '?':
+                case '{':
+                        /* the last atom may not be there at all */
+                        if (atom >= 0)
+                                g_string_truncate(run, atom);
+                        regex_literal_end(best, run);
+                        atom = -1;
+                        if (*p == '{') {
+                                /* otherwise the brace would be a literal */
+                                p += 1 + strspn(p + 1, "0123456789,");
+                                if (*p != '}')
+                                        goto fail;
+                        }
+                        p++;
+                        if (*p == '?' || *p == '+')
+                                p++;
+                        break;
+                case '+':
+                        /* the last atom is there, but maybe repeated */
+                        regex_literal_end(best, run);
+                        atom = -1;
+                        p++;
+                        if (*p == '?' || *p == '+')
+                                p++;
+                        break;
+                case '(':
+                case '[':
+                        regex_literal_end(best, run);
+                        atom = -1;
+                        p = *p == '(' ? regex_skip_group(p) : regex_skip_class(p);
+                        if (!p)
+                                goto fail;
+                        break;
+                case '.':
+                case '^':
+                case '$':
+                case ')':
+                        regex_literal_end(best, run);
+                        atom = -1;
+                        p++;
+                        break;
+                case '\\':
+                        p++;
+                        if (g_ascii_isalnum(*p)) {
+                                /* only escapes, which stand for a single character type or an assertion */
+                                if (!strchr("dDwWsSbBAzZGhHvVRXntrfea", *p))
+                                        goto fail;
+                                regex_literal_end(best, run);
+                                atom = -1;
+                                p++;
+                                break;
+                        }
+                        if (!*p || (guchar) *p >= 0x80)
+                                goto fail;
+                        /* fall through to the escaped character */
+                default:
+                        if (caseless && ((guchar) *p >= 0x80 || strchr("kKsS", *p))) {
+                                /* Unicode folds them with the Kelvin sign and long s */
+                                regex_literal_end(best, run);
+                                atom = -1;
+                                p += g_utf8_skip[(guchar) *p];
+                                break;
+                        }
+                        atom = run->len;
+                        if ((guchar) *p >= 0x80) {
+                                int skip = g_utf8_skip[(guchar) *p];
+                                g_string_append_len(run, p, skip);
+                                p += skip;
+                        } else {
+                                g_string_append_c(run, caseless ? g_ascii_tolower(*p) : *p);
+                                p++;
+                        }
+                        break;
+                }
+        }
+        regex_literal_end(best, run);
+        goto out;
+
+fail:
+        /* a later alternative might not need anything found so far */
+        g_string_truncate(best, 0);
+out:
+        g_string_free(run, true);
+        *len = best->len;
+        return g_string_free(best, best->len == 0);
+}
+
+static void compiled_regex_free(gpointer data)
+{
+        struct compiled_regex *re = data;
+
+        if (re->regex)
+                g_regex_unref(re->regex);
+        g_free(re->literal);
+        g_free(re);
+}
+
+/*
+ * Get the compiled regular expression for pattern in the given mode.
+ * Once compiled, expressions are kept until no compiled rule uses them
+ * anymore.
+ */
+static const struct compiled_regex *regex_compile(const char *pattern, enum match_mode mode)
+{
+        if (!regex_cache)
+                regex_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, compiled_regex_free);
+
+        char *key = g_strdup_printf("%d:%s", mode, pattern);
+        struct compiled_regex *re = g_hash_table_lookup(regex_cache, key);
+        if (re) {
+                g_free(key);
+                return re;
+        }
+
+        /* take it over from the previous rules */
+        gpointer stale_key;
+        if (stale_regex_cache
+            && g_hash_table_lookup_extended(stale_regex_cache, key, &stale_key, (gpointer *) &re)) {
+                g_hash_table_steal(stale_regex_cache, key);
+                g_free(stale_key);
+                g_hash_table_insert(regex_cache, key, re);
+                return re;
+        }
+
+        re = g_malloc0(sizeof(struct compiled_regex));
+        re->caseless = mode == MATCH_GLOB_CASELESS || mode == MATCH_REGEX_CASELESS;
+
+        GRegexCompileFlags flags = G_REGEX_OPTIMIZE;
+        char *source;
+        if (mode == MATCH_GLOB_CASELESS) {
+                source = glob_to_regex(pattern);
+                flags |= G_REGEX_DOTALL;
+        } else {
+                source = g_strdup(pattern);
+        }
+        if (re->caseless)
+                flags |= G_REGEX_CASELESS;
+
+        GError *error = NULL;
+        re->regex = g_regex_new(source, flags, 0, &error);
+        if (re->regex) {
+                re->literal = regex_required_literal(source, re->caseless, &re->len);
+        } else {
+                fprintf(stderr, "Warning: invalid pattern \"%s\": %s\n", pattern, error->message);
+                g_error_free(error);
+        }
+
+        g_free(source);
+        g_hash_table_insert(regex_cache, key, re);
+        return re;
+}
+
+/*
+ * Like strstr, but ignore the case of ASCII letters. needle has to be
+ * lowercase.
+ */
+static const char *ascii_strcasestr(const char *haystack, const char *needle, size_t len)
+{
+        char first[] = { needle[0], g_ascii_toupper(needle[0]), '\0' };
+
+        for (haystack += strcspn(haystack, first); *haystack; haystack += 1 + strcspn(haystack + 1, first)) {
+                if (g_ascii_strncasecmp(haystack, needle, len) == 0)
+                        return haystack;
+        }
+
+        return NULL;
+}
+
+static bool regex_matches(const struct compiled_regex *re, const char *str)
+{
+        if (!re->regex)
+                return false;
+
+        /* reject most strings without running the regex engine */
+        if (re->literal) {
+                if (re->caseless ? !ascii_strcasestr(str, re->literal, re->len)
+                                 : !strstr(str, re->literal))
+                        return false;
+        }
+
+        return g_regex_match(re->regex, str, 0, NULL);
+}
+
+static void pattern_compile(struct pattern *p, const char *glob, enum match_mode mode)
+{
+        p->glob = glob;
+        p->literal = NULL;
+        p->len = 0;
+        p->regex = NULL;
+
+        if (!glob) {
+                p->type = PATTERN_NONE;
+                return;
+        }
+
+        if (mode != MATCH_GLOB) {
+                p->type = PATTERN_REGEX;
+                p->regex = regex_compile(glob, mode);
+                return;
+        }
+
+        if (strpbrk(glob, "?[\\")) {
+                p->type = PATTERN_GLOB;
+                return;
+        }
+
+        const char *start = glob;
+        const char *end = glob + strlen(glob);
+        bool leading = false, trailing = false;
+
+        while (start < end && *start == '*') {
+                start++;
+                leading = true;
+        }
+        while (end > start && end[-1] == '*') {
+                end--;
+                trailing = true;
+        }
+
+        if (memchr(start, '*', end - start)) {
+                p->type = PATTERN_GLOB;
+                return;
+        }
+
+        if (start == end && (leading || trailing))
+                p->type = PATTERN_ANY;
+        else if (leading && trailing)
+                p->type = PATTERN_SUBSTRING;
+        else if (leading)
+                p->type = PATTERN_SUFFIX;
+        else if (trailing)
+                p->type = PATTERN_PREFIX;
+        else
+                p->type = PATTERN_LITERAL;
+
+        p->literal = g_strndup(start, end - start);
+        p->len = end - start;
+}
+
+static bool pattern_matches(const struct pattern *p, const char *str)
+{
+        size_t len;
+
+        if (!str)
+                str = "";
+
+        switch (p->type) {
+        case PATTERN_NONE:
+        case PATTERN_ANY:
+                return true;
+        case PATTERN_LITERAL:
+                return strcmp(str, p->literal) == 0;
+        case PATTERN_PREFIX:
+                return strncmp(str, p->literal, p->len) == 0;
+        case PATTERN_SUFFIX:
+                len = strlen(str);
+                return len >= p->len
+                       && memcmp(str + len - p->len, p->literal, p->len) == 0;
+        case PATTERN_SUBSTRING:
+                return strstr(str, p->literal) != NULL;
+        case PATTERN_GLOB:
+                return fnmatch(p->glob, str, 0) == 0;
+        case PATTERN_REGEX:
+                return regex_matches(p->regex, str);
+        }
+
+        return false;
+}
+
+/*
+ * Check the filters of the rule, which only depend on the attributes
+ * in struct rule_cache_key.
+ */
+static bool rule_matcher_matches_attributes(const struct rule_matcher *m, const notification *n)
+{
+        const rule_t *r = m->rule;
+
+        return (r->match_transient == -1 || (r->match_transient == n->transient))
+               && (r->msg_urgency == URG_NONE || r->msg_urgency == n->urgency)
+               && pattern_matches(&m->appname, n->appname)
+               && pattern_matches(&m->category, n->category);
+}
+
+static bool pattern_filters(const struct pattern *p)
+{
+        return p->type != PATTERN_NONE && p->type != PATTERN_ANY;
+}
+
+/*
+ * Check whether the rule filters on the content of notifications.
+ */
+static bool rule_matcher_filters_content(const struct rule_matcher *m)
+{
+        return pattern_filters(&m->icon)
+               || pattern_filters(&m->summary)
+               || pattern_filters(&m->body);
+}
+
+static bool rule_matcher_matches_content(const struct rule_matcher *m, const notification *n)
+{
+        return pattern_matches(&m->icon, n->icon)
+               && pattern_matches(&m->summary, n->summary)
+               && pattern_matches(&m->body, n->body);
+}
+
+/*
+ * Merge the actions of r into merged, so that applying merged has the
+ * same effect as applying all merged rules in order.
+ */
+static void rule_merge(rule_t *merged, const rule_t *r)
+{
+        if (r->timeout != -1)
+                merged->timeout = r->timeout;
+        if (r->urgency != URG_NONE)
+                merged->urgency = r->urgency;
+        if (r->history_ignore != -1)
+                merged->history_ignore = r->history_ignore;
+        if (r->set_transient != -1)
+                merged->set_transient = r->set_transient;
+        if (r->markup != MARKUP_NULL)
+                merged->markup = r->markup;
+        if (r->new_icon)
+                merged->new_icon = r->new_icon;
+        if (r->fg)
+                merged->fg = r->fg;
+        if (r->bg)
+                merged->bg = r->bg;
+        if (r->format)
+                merged->format = r->format;
+        if (r->script)
+                merged->script = r->script;
+}
+
+static guint rule_cache_key_hash(gconstpointer data)
+{
+        const struct rule_cache_key *key = data;
+
+        return g_str_hash(key->appname) * 31
+               + g_str_hash(key->category) * 7
+               + key->urgency * 2
+               + key->transient;
+}
+
+static gboolean rule_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+        const struct rule_cache_key *ka = a, *kb = b;
+
+        return ka->urgency == kb->urgency
+               && ka->transient == kb->transient
+               && strcmp(ka->appname, kb->appname) == 0
+               && strcmp(ka->category, kb->category) == 0;
+}
+
+static void rule_cache_key_free(gpointer data)
+{
+        struct rule_cache_key *key = data;
+
+        g_free(key->appname);
+        g_free(key->category);
+        g_free(key);
+}
+
+/*
+ * Get the hit and miss counts of the rule cache.
+ */
+void rules_cache_stats(guint64 *hits, guint64 *misses)
+{
+        *hits = rule_cache_hits;
+        *misses = rule_cache_misses;
+}
+
+/*
+ * Get the amount of compiled regular expressions kept for the rules.
+ */
+guint rules_regex_count(void)
+{
+        return regex_cache ? g_hash_table_size(regex_cache) : 0;
+}
+
+static void rule_index_add(GHashTable *index, const char *key, guint i)
+{
+        GArray *indices = g_hash_table_lookup(index, key);
+
+        if (!indices) {
+                indices = g_array_new(false, false, sizeof(guint));
+                g_hash_table_insert(index, (gpointer) key, indices);
+        }
+        g_array_append_val(indices, i);
+}
+
+static void rule_index_free(gpointer data)
+{
+        g_array_free(data, true);
+}
+
+static void rule_matchers_free(void)
+{
+        if (!matchers)
+                return;
+
+        for (guint i = 0; i < matchers->len; i++) {
+                struct rule_matcher *m = &g_array_index(matchers, struct rule_matcher, i);
+                g_free(m->appname.literal);
+                g_free(m->summary.literal);
+                g_free(m->body.literal);
+                g_free(m->icon.literal);
+                g_free(m->category.literal);
+        }
+
+        g_array_free(matchers, true);
+        g_hash_table_destroy(rule_cache);
+        g_hash_table_destroy(by_appname);
+        g_hash_table_destroy(by_category);
+        g_array_free(unindexed, true);
+
+        matchers = NULL;
+        rule_cache = NULL;
+        by_appname = NULL;
+        by_category = NULL;
+        unindexed = NULL;
+}
+
+/*
+ * Free the compiled rules and regular expressions.
+ */
+void rules_teardown(void)
+{
+        rule_matchers_free();
+
+        if (regex_cache) {
+                g_hash_table_destroy(regex_cache);
+                regex_cache = NULL;
+        }
+}
+
+/*
+ * Compile the filters of all rules and index the rules by their
+ * literal appname or category filters.
+ *
+ * Has to be called again after the rules list has been changed,
+ * which also forgets all cached rule outcomes.
+ */
+void rules_compile(void)
+{
+        rule_matchers_free();
+
+        /* only keep the expressions the new rules still use */
+        stale_regex_cache = regex_cache;
+        regex_cache = NULL;
+
+        matchers = g_array_new(false, false, sizeof(struct rule_matcher));
+        /* the keys belong to the literal patterns */
+        by_appname = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, rule_index_free);
+        by_category = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, rule_index_free);
+        unindexed = g_array_new(false, false, sizeof(guint));
+        rule_cache = g_hash_table_new_full(rule_cache_key_hash, rule_cache_key_equal,
+                                           rule_cache_key_free, g_free);
+
         for (GSList *iter = rules; iter; iter = iter->next) {
+                struct rule_matcher m;
                 rule_t *r = iter->data;
-                if (rule_matches_notification(r, n)) {
-                        rule_apply(r, n);
+
+                m.rule = r;
+                pattern_compile(&m.appname, r->appname, r->appname_match);
+                pattern_compile(&m.summary, r->summary, r->summary_match);
+                pattern_compile(&m.body, r->body, r->body_match);
+                pattern_compile(&m.icon, r->icon, r->icon_match);
+                pattern_compile(&m.category, r->category, r->category_match);
+
+                guint i = matchers->len;
+                g_array_append_val(matchers, m);
+
+                if (m.appname.type == PATTERN_LITERAL)
+                        rule_index_add(by_appname, m.appname.literal, i);
+                else if (m.category.type == PATTERN_LITERAL)
+                        rule_index_add(by_category, m.category.literal, i);
+                else
+                        g_array_append_val(unindexed, i);
+        }
+
+        if (stale_regex_cache) {
+                g_hash_table_destroy(stale_regex_cache);
+                stale_regex_cache = NULL;
+        }
+}
+
+/*
+ * Check all rules if they match n and apply.
+ *
+ * Only the rules indexed under the appname and category of n and the
+ * unindexed ones are candidates. They get checked in the order of the
+ * rules list, as applied rules may change the urgency, icon or
+ * transient flag matched by later ones.
+ *
+ * If no rule filtering on the icon, summary or body got past its other
+ * filters, the outcome only depends on the attributes in struct
+ * rule_cache_key. The merged effect of the matching rules gets cached
+ * for them then.
+ */
+void rule_apply_all(notification *n)
+{
+        if (!matchers)
+                rules_compile();
+
+        struct rule_cache_key key = {
+                .appname = n->appname ? n->appname : "",
+                .category = n->category ? n->category : "",
+                .urgency = n->urgency,
+                .transient = n->transient,
+        };
+
+        rule_t *cached = g_hash_table_lookup(rule_cache, &key);
+        if (cached) {
+                rule_cache_hits++;
+                rule_apply(cached, n);
+                return;
+        }
+        rule_cache_misses++;
+
+        rule_t merged;
+        rule_init(&merged);
+        merged.history_ignore = -1;
+        bool cacheable = true;
+
+        GArray *candidates[] = {
+                n->appname ? g_hash_table_lookup(by_appname, n->appname) : NULL,
+                n->category ? g_hash_table_lookup(by_category, n->category) : NULL,
+                unindexed,
+        };
+        guint pos[G_N_ELEMENTS(candidates)] = { 0 };
+
+        for (;;) {
+                int next = -1;
+                guint next_index = G_MAXUINT;
+
+                /* merge the candidates by their position in the rules list */
+                for (int c = 0; c < G_N_ELEMENTS(candidates); c++) {
+                        if (!candidates[c] || pos[c] >= candidates[c]->len)
+                                continue;
+
+                        guint index = g_array_index(candidates[c], guint, pos[c]);
+                        if (index < next_index) {
+                                next = c;
+                                next_index = index;
+                        }
                 }
+
+                if (next == -1)
+                        break;
+                pos[next]++;
+
+                struct rule_matcher *m = &g_array_index(matchers, struct rule_matcher, next_index);
+                if (!rule_matcher_matches_attributes(m, n))
+                        continue;
+
+                if (rule_matcher_filters_content(m)) {
+                        cacheable = false;
+                        if (!rule_matcher_matches_content(m, n))
+                                continue;
+                }
+
+                rule_apply(m->rule, n);
+                rule_merge(&merged, m->rule);
         }
+
+        if (!cacheable)
+                return;
+
+        if (g_hash_table_size(rule_cache) >= RULE_CACHE_MAX)
+                g_hash_table_remove_all(rule_cache);
+
+        struct rule_cache_key *stored = g_memdup(&key, sizeof(key));
+        stored->appname = g_strdup(key.appname);
+        stored->category = g_strdup(key.category);
+        g_hash_table_insert(rule_cache, stored, g_memdup(&merged, sizeof(merged)));
 }
 
 /*
@@ -63,6 +896,11 @@ void rule_init(rule_t *r)
         r->icon = NULL;
         r->category = NULL;
         r->msg_urgency = URG_NONE;
+        r->appname_match = MATCH_GLOB;
+        r->summary_match = MATCH_GLOB;
+        r->body_match = MATCH_GLOB;
+        r->icon_match = MATCH_GLOB;
+        r->category_match = MATCH_GLOB;
         r->timeout = -1;
         r->urgency = URG_NONE;
         r->markup = MARKUP_NULL;
@@ -73,6 +911,18 @@ void rule_init(rule_t *r)
         r->fg = NULL;
         r->bg = NULL;
         r->format = NULL;
+        r->script = NULL;
+}
+
+static bool rule_field_matches(const char *pattern, enum match_mode mode, const char *str)
+{
+        if (!pattern)
+                return true;
+        if (mode == MATCH_GLOB)
+                return !fnmatch(pattern, str, 0);
+
+        const struct compiled_regex *re = regex_compile(pattern, mode);
+        return re->regex && g_regex_match(re->regex, str, 0, NULL);
 }
 
 /*
@@ -80,11 +930,11 @@ void rule_init(rule_t *r)
  */
 bool rule_matches_notification(rule_t *r, notification *n)
 {
-        return ((!r->appname || !fnmatch(r->appname, n->appname, 0))
-                && (!r->summary || !fnmatch(r->summary, n->summary, 0))
-                && (!r->body || !fnmatch(r->body, n->body, 0))
-                && (!r->icon || !fnmatch(r->icon, n->icon, 0))
-                && (!r->category || !fnmatch(r->category, n->category, 0))
+        return (rule_field_matches(r->appname, r->appname_match, n->appname)
+                && rule_field_matches(r->summary, r->summary_match, n->summary)
+                && rule_field_matches(r->body, r->body_match, n->body)
+                && rule_field_matches(r->icon, r->icon_match, n->icon)
+                && rule_field_matches(r->category, r->category_match, n->category)
                 && (r->match_transient == -1 || (r->match_transient == n->transient))
                 && (r->msg_urgency == URG_NONE || r->msg_urgency == n->urgency));
 }
@@ -8,6 +8,13 @@
 #include "notification.h"
 #include "settings.h"
 
+enum match_mode {
+        MATCH_GLOB,             /* shell-like globbing with fnmatch */
+        MATCH_GLOB_CASELESS,
+        MATCH_REGEX,            /* perl compatible regular expressions */
+        MATCH_REGEX_CASELESS,
+};
+
 typedef struct _rule_t {
         char *name;
         /* filters */
@@ -17,6 +24,11 @@ typedef struct _rule_t {
         char *icon;
         char *category;
         int msg_urgency;
+        enum match_mode appname_match;
+        enum match_mode summary_match;
+        enum match_mode body_match;
+        enum match_mode icon_match;
+        enum match_mode category_match;
 
         /* actions */
         gint64 timeout;
@@ -37,6 +49,10 @@ extern GSList *rules;
 void rule_init(rule_t *r);
 void rule_apply(rule_t *r, notification *n);
 void rule_apply_all(notification *n);
+void rules_compile(void);
+void rules_teardown(void);
+void rules_cache_stats(guint64 *hits, guint64 *misses);
+guint rules_regex_count(void);
 bool rule_matches_notification(rule_t *r, notification *n);
 
 #endif
@@ -4,6 +4,7 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #ifndef STATIC_CONFIG
 #include <basedir.h>
@@ -13,12 +14,47 @@
 #include "rules.h" // put before config.h to fix missing include
 #include "config.h"
 #include "dunst.h"
+#include "format.h"
 #include "notification.h"
 #include "option_parser.h"
 #include "utils.h"
 
 settings_t settings;
 
+/* path of the loaded dunstrc or NULL */
+static char *config_path = NULL;
+
+/*
+ * Get the path of the dunstrc loaded by the last load_settings call.
+ *
+ * Returns NULL, if none was found.
+ */
+const char *settings_config_path(void)
+{
+        return config_path;
+}
+
+#ifndef STATIC_CONFIG
+/*
+ * Like xdgConfigOpen, but remember the path of the opened file.
+ */
+static FILE *xdg_config_open(const char *relpath, xdgHandle *xdg)
+{
+        char *paths = xdgConfigFind(relpath, xdg);
+        FILE *file = NULL;
+
+        /* paths is a list of NUL separated paths, ending with an empty one */
+        for (const char *path = paths; path && *path && !file; path += strlen(path) + 1) {
+                file = fopen(path, "r");
+                if (file)
+                        config_path = g_strdup(path);
+        }
+
+        free(paths);
+        return file;
+}
+#endif
+
 static void parse_follow_mode(const char *mode)
 {
         if (strcmp(mode, "mouse") == 0)
@@ -68,6 +104,29 @@ static enum urgency ini_get_urgency(const char *section, const char *key, const
         return ret;
 }
 
+static enum match_mode ini_get_match_mode(const char *section, const char *key, enum match_mode def)
+{
+        enum match_mode ret = def;
+        char *mode = ini_get_string(section, key, "");
+
+        if (strlen(mode) > 0) {
+                if (strcmp(mode, "glob") == 0)
+                        ret = MATCH_GLOB;
+                else if (strcmp(mode, "iglob") == 0)
+                        ret = MATCH_GLOB_CASELESS;
+                else if (strcmp(mode, "regex") == 0)
+                        ret = MATCH_REGEX;
+                else if (strcmp(mode, "iregex") == 0)
+                        ret = MATCH_REGEX_CASELESS;
+                else
+                        fprintf(stderr,
+                                "unknown match mode: %s, ignoring\n",
+                                mode);
+        }
+        g_free(mode);
+        return ret;
+}
+
 void load_settings(char *cmdline_config_path)
 {
 
@@ -77,8 +136,12 @@ void load_settings(char *cmdline_config_path)
 
         xdgInitHandle(&xdg);
 
+        g_free(config_path);
+        config_path = NULL;
+
         if (cmdline_config_path != NULL) {
                 config_file = fopen(cmdline_config_path, "r");
+                config_path = g_strdup(cmdline_config_path);
 
                 if(!config_file) {
                         char *msg = g_strdup_printf(
@@ -88,12 +151,12 @@ void load_settings(char *cmdline_config_path)
                 }
         }
         if (config_file == NULL) {
-                config_file = xdgConfigOpen("dunst/dunstrc", "r", &xdg);
+                config_file = xdg_config_open("dunst/dunstrc", &xdg);
         }
         if (config_file == NULL) {
                 /* Fall back to just "dunstrc", which was used before 2013-06-23
                  * (before v0.2). */
-                config_file = xdgConfigOpen("dunstrc", "r", &xdg);
+                config_file = xdg_config_open("dunstrc", &xdg);
                 if (config_file == NULL) {
                         puts("no dunstrc found -> skipping\n");
                         xdgWipeHandle(&xdg);
@@ -125,6 +188,9 @@ void load_settings(char *cmdline_config_path)
         );
 
         {
+                /* forget the markup mode of earlier loads */
+                settings.markup = MARKUP_NULL;
+
                 // Check if allow_markup set
                 if (ini_is_set("global", "allow_markup")) {
                         bool allow_markup = option_get_bool(
@@ -159,6 +225,7 @@ void load_settings(char *cmdline_config_path)
                 "format", "-format", defaults.format,
                 "The format template for the notifications"
         );
+        format_compile(settings.format);
 
         settings.sort = option_get_bool(
                 "global",
@@ -312,6 +379,46 @@ void load_settings(char *cmdline_config_path)
                 "Max amount of notifications kept in history"
         );
 
+        settings.history_memory = option_get_int(
+                "global",
+                "history_memory", "-history_memory", defaults.history_memory,
+                "Max amount of memory in bytes used by the notifications kept in history"
+        );
+
+        if (settings.history_memory < 0) {
+                fprintf(stderr, "Warning: Invalid history_memory %d, using the default of %d bytes\n",
+                        settings.history_memory, defaults.history_memory);
+                settings.history_memory = defaults.history_memory;
+        }
+
+        settings.persistent_history = option_get_bool(
+                "global",
+                "persistent_history", "-persistent_history", defaults.persistent_history,
+                "Keep history across restarts"
+        );
+
+        {
+                char *c = option_get_string(
+                        "global",
+                        "history_raw_icon", "-history_raw_icon", "",
+                        "Keep, scale down or drop raw icons of notifications in history"
+                );
+
+                if (strlen(c) == 0) {
+                        settings.history_raw_icon = defaults.history_raw_icon;
+                } else if (strcmp(c, "keep") == 0) {
+                        settings.history_raw_icon = HISTORY_RAW_ICON_KEEP;
+                } else if (strcmp(c, "scale") == 0) {
+                        settings.history_raw_icon = HISTORY_RAW_ICON_SCALE;
+                } else if (strcmp(c, "drop") == 0) {
+                        settings.history_raw_icon = HISTORY_RAW_ICON_DROP;
+                } else {
+                        fprintf(stderr, "Warning: unknown history_raw_icon value: \"%s\"\n", c);
+                        settings.history_raw_icon = defaults.history_raw_icon;
+                }
+                g_free(c);
+        }
+
         settings.show_indicators = option_get_bool(
                 "global",
                 "show_indicators", "-show_indicators", defaults.show_indicators,
@@ -426,6 +533,18 @@ void load_settings(char *cmdline_config_path)
                 "Scale larger icons down to this size, set to 0 to disable"
         );
 
+        settings.icon_cache_memory = option_get_int(
+                "global",
+                "icon_cache_memory", "-icon_cache_memory", defaults.icon_cache_memory,
+                "Max amount of memory in bytes used by cached icons, set to 0 to disable"
+        );
+
+        if (settings.icon_cache_memory < 0) {
+                fprintf(stderr, "Warning: Invalid icon_cache_memory %d, using the default of %d bytes\n",
+                        settings.icon_cache_memory, defaults.icon_cache_memory);
+                settings.icon_cache_memory = defaults.icon_cache_memory;
+        }
+
         // If the deprecated icon_folders option is used,
         // read it and generate its usage string.
         if (ini_is_set("global", "icon_folders") || cmdline_is_set("-icon_folders")) {
@@ -571,6 +690,12 @@ void load_settings(char *cmdline_config_path)
                 "Icon for notifications with critical urgency"
         );
 
+        /* x_shortcut_init fills in the rest again for the new strings */
+        settings.close_ks = (keyboard_shortcut) { 0 };
+        settings.close_all_ks = (keyboard_shortcut) { 0 };
+        settings.history_ks = (keyboard_shortcut) { 0 };
+        settings.context_ks = (keyboard_shortcut) { 0 };
+
         settings.close_ks.str = option_get_string(
                 "shortcuts",
                 "close", "-key", defaults.close_ks.str,
@@ -606,11 +731,21 @@ void load_settings(char *cmdline_config_path)
                 "Always run rule-defined scripts, even if the notification is suppressed with format = \"\"."
         );
 
-        /* push hardcoded default rules into rules list */
-        for (int i = 0; i < G_N_ELEMENTS(default_rules); i++) {
-                rules = g_slist_insert(rules, &(default_rules[i]), -1);
+        /* Drop the rules of earlier loads. Their strings stay allocated,
+         * as notifications may still point to their format, colors or
+         * script. */
+        g_slist_free_full(rules, g_free);
+        rules = NULL;
+
+        /* push copies of the hardcoded default rules into rules list,
+         * so that dunstrc only overrides them until the next load */
+        for (int i = G_N_ELEMENTS(default_rules) - 1; i >= 0; i--) {
+                rules = g_slist_prepend(rules, g_memdup(&default_rules[i], sizeof(rule_t)));
         }
 
+        /* the rules of dunstrc in reverse order */
+        GSList *added = NULL;
+
         const char *cur_section = NULL;
         for (;;) {
                 cur_section = next_section(cur_section);
@@ -625,7 +760,8 @@ void load_settings(char *cmdline_config_path)
                     || strcmp(cur_section, "urgency_critical") == 0)
                         continue;
 
-                /* check for existing rule with same name */
+                /* check for a default rule with the same name, as
+                 * section names are unique otherwise */
                 rule_t *r = NULL;
                 for (GSList *iter = rules; iter; iter = iter->next) {
                         rule_t *match = iter->data;
@@ -637,7 +773,7 @@ void load_settings(char *cmdline_config_path)
                 if (r == NULL) {
                         r = g_malloc(sizeof(rule_t));
                         rule_init(r);
-                        rules = g_slist_insert(rules, r, -1);
+                        added = g_slist_prepend(added, r);
                 }
 
                 r->name = g_strdup(cur_section);
@@ -646,6 +782,11 @@ void load_settings(char *cmdline_config_path)
                 r->body = ini_get_string(cur_section, "body", r->body);
                 r->icon = ini_get_string(cur_section, "icon", r->icon);
                 r->category = ini_get_string(cur_section, "category", r->category);
+                r->appname_match = ini_get_match_mode(cur_section, "appname_match", r->appname_match);
+                r->summary_match = ini_get_match_mode(cur_section, "summary_match", r->summary_match);
+                r->body_match = ini_get_match_mode(cur_section, "body_match", r->body_match);
+                r->icon_match = ini_get_match_mode(cur_section, "icon_match", r->icon_match);
+                r->category_match = ini_get_match_mode(cur_section, "category_match", r->category_match);
                 r->timeout = ini_get_time(cur_section, "timeout", r->timeout);
 
                 {
@@ -665,6 +806,8 @@ void load_settings(char *cmdline_config_path)
                 r->fg = ini_get_string(cur_section, "foreground", r->fg);
                 r->bg = ini_get_string(cur_section, "background", r->bg);
                 r->format = ini_get_string(cur_section, "format", r->format);
+                if (r->format)
+                        format_compile(r->format);
                 r->new_icon = ini_get_string(cur_section, "new_icon", r->new_icon);
                 r->history_ignore = ini_get_bool(cur_section, "history_ignore", r->history_ignore);
                 r->match_transient = ini_get_bool(cur_section, "match_transient", r->match_transient);
@@ -672,6 +815,9 @@ void load_settings(char *cmdline_config_path)
                 r->script = ini_get_path(cur_section, "script", NULL);
         }
 
+        rules = g_slist_concat(rules, g_slist_reverse(added));
+        rules_compile();
+
 #ifndef STATIC_CONFIG
         if (config_file) {
                 fclose(config_file);
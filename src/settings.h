@@ -12,6 +12,7 @@ enum icon_position_t { icons_left, icons_right, icons_off };
 enum separator_color { FOREGROUND, AUTO, FRAME, CUSTOM };
 enum follow_mode { FOLLOW_NONE, FOLLOW_MOUSE, FOLLOW_KEYBOARD };
 enum markup_mode { MARKUP_NULL, MARKUP_NO, MARKUP_STRIP, MARKUP_FULL };
+enum history_raw_icon { HISTORY_RAW_ICON_KEEP, HISTORY_RAW_ICON_SCALE, HISTORY_RAW_ICON_DROP };
 
 typedef struct _settings {
         bool print_notifications;
@@ -44,6 +45,9 @@ typedef struct _settings {
         enum alignment align;
         int sticky_history;
         int history_length;
+        int history_memory;
+        enum history_raw_icon history_raw_icon;
+        bool persistent_history;
         int show_indicators;
         int word_wrap;
         enum ellipsize ellipsize;
@@ -64,6 +68,7 @@ typedef struct _settings {
         char *browser;
         enum icon_position_t icon_position;
         int max_icon_size;
+        int icon_cache_memory;
         char *icon_path;
         enum follow_mode f_mode;
         bool always_run_script;
@@ -77,6 +82,7 @@ typedef struct _settings {
 extern settings_t settings;
 
 void load_settings(char *cmdline_config_path);
+const char *settings_config_path(void);
 
 #endif
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
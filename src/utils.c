@@ -4,6 +4,8 @@
 #include <assert.h>
 #include <errno.h>
 #include <glib.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,11 +55,71 @@ char *string_replace(const char *needle, const char *replacement, char *haystack
         return string_replace_at(haystack, (start - haystack), strlen(needle), replacement);
 }
 
+string_builder *string_builder_new(gsize reserve)
+{
+        return g_string_sized_new(reserve);
+}
+
+void string_builder_reserve(string_builder *b, gsize len)
+{
+        gsize old_len = b->len;
+
+        /* GString grows to the next power of two */
+        g_string_set_size(b, old_len + len);
+        g_string_truncate(b, old_len);
+}
+
+void string_builder_append(string_builder *b, const char *str, gssize len)
+{
+        g_string_append_len(b, str, len < 0 ? strlen(str) : len);
+}
+
+void string_builder_append_escaped(string_builder *b, const char *str, gssize len)
+{
+        const char *end = str + (len < 0 ? strlen(str) : len);
+
+        while (str < end) {
+                const char *run = str;
+                while (str < end && !strchr("&\"'<>", *str))
+                        str++;
+                g_string_append_len(b, run, str - run);
+
+                if (str == end)
+                        break;
+
+                switch (*str++) {
+                case '&':  g_string_append_len(b, "&amp;", 5);  break;
+                case '"':  g_string_append_len(b, "&quot;", 6); break;
+                case '\'': g_string_append_len(b, "&apos;", 6); break;
+                case '<':  g_string_append_len(b, "&lt;", 4);   break;
+                case '>':  g_string_append_len(b, "&gt;", 4);   break;
+                }
+        }
+}
+
+void string_builder_append_printf(string_builder *b, const char *format, ...)
+{
+        va_list args;
+
+        va_start(args, format);
+        g_string_append_vprintf(b, format, args);
+        va_end(args);
+}
+
+char *string_builder_steal(string_builder *b)
+{
+        return g_string_free(b, false);
+}
+
+void string_builder_free(string_builder *b)
+{
+        g_string_free(b, true);
+}
+
 char *string_replace_all(const char *needle, const char *replacement, char *haystack)
 {
-        char *start;
-        int needle_pos;
-        int needle_len, repl_len;
+        const char *start, *read;
+        size_t needle_len, repl_len;
 
         needle_len = strlen(needle);
         if (needle_len == 0) {
@@ -65,14 +127,40 @@ char *string_replace_all(const char *needle, const char *replacement, char *hays
         }
 
         start = strstr(haystack, needle);
+        if (start == NULL) {
+                return haystack;
+        }
+
         repl_len = strlen(replacement);
 
-        while (start != NULL) {
-                needle_pos = start - haystack;
-                haystack = string_replace_at(haystack, needle_pos, needle_len, replacement);
-                start = strstr(haystack + needle_pos + repl_len, needle);
+        /* the result fits into haystack, so replace in place */
+        if (repl_len <= needle_len) {
+                char *write = haystack + (start - haystack);
+                read = start;
+
+                do {
+                        memmove(write, read, start - read);
+                        write += start - read;
+                        memcpy(write, replacement, repl_len);
+                        write += repl_len;
+                        read = start + needle_len;
+                } while ((start = strstr(read, needle)) != NULL);
+
+                memmove(write, read, strlen(read) + 1);
+                return haystack;
         }
-        return haystack;
+
+        string_builder *b = string_builder_new(strlen(haystack) + repl_len - needle_len);
+        read = haystack;
+        do {
+                string_builder_append(b, read, start - read);
+                string_builder_append(b, replacement, repl_len);
+                read = start + needle_len;
+        } while ((start = strstr(read, needle)) != NULL);
+        string_builder_append(b, read, -1);
+
+        g_free(haystack);
+        return string_builder_steal(b);
 }
 
 char *string_append(char *a, const char *b, const char *sep)
@@ -84,15 +172,17 @@ char *string_append(char *a, const char *b, const char *sep)
         if (!b || *b == '\0')
                 return a;
 
-        char *new;
-        if (!sep)
-                new = g_strconcat(a, b, NULL);
-        else
-                new = g_strconcat(a, sep, b, NULL);
-        g_free(a);
+        size_t a_len = strlen(a), b_len = strlen(b);
+        size_t sep_len = sep ? strlen(sep) : 0;
 
-        return new;
+        string_builder *new = string_builder_new(a_len + sep_len + b_len);
+        string_builder_append(new, a, a_len);
+        if (sep)
+                string_builder_append(new, sep, sep_len);
+        string_builder_append(new, b, b_len);
+        g_free(a);
 
+        return string_builder_steal(new);
 }
 
 void string_strip_delimited(char *str, char a, char b)
@@ -164,6 +254,50 @@ gint64 string_to_time(const char *string)
                 return 0;
 }
 
+/*
+ * MurmurHash64A by Austin Appleby (public domain).
+ *
+ * Not suitable against malicious input, but fast and well distributed
+ * for telling notification contents apart.
+ */
+guint64 hash_data(const void *data, gsize len, guint64 seed)
+{
+        const guint64 m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+        const unsigned char *p = data;
+
+        guint64 h = seed ^ (len * m);
+
+        for (; len >= 8; len -= 8, p += 8) {
+                guint64 k;
+                memcpy(&k, p, sizeof(k));
+
+                k *= m;
+                k ^= k >> r;
+                k *= m;
+
+                h ^= k;
+                h *= m;
+        }
+
+        switch (len) {
+        case 7: h ^= (guint64) p[6] << 48; /* fall through */
+        case 6: h ^= (guint64) p[5] << 40; /* fall through */
+        case 5: h ^= (guint64) p[4] << 32; /* fall through */
+        case 4: h ^= (guint64) p[3] << 24; /* fall through */
+        case 3: h ^= (guint64) p[2] << 16; /* fall through */
+        case 2: h ^= (guint64) p[1] << 8;  /* fall through */
+        case 1: h ^= (guint64) p[0];
+                h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+
+        return h;
+}
+
 void die(char *text, int exit_value)
 {
         fputs(text, stderr);
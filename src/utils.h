@@ -4,6 +4,30 @@
 
 #include <glib.h>
 
+/* a growable string, which doubles its capacity when it runs out of space */
+typedef GString string_builder;
+
+/* create a string builder with room for at least <reserve> characters */
+string_builder *string_builder_new(gsize reserve);
+
+/* make room for at least <len> more characters */
+void string_builder_reserve(string_builder *b, gsize len);
+
+/* append <len> characters of <str>, or all of them if <len> is negative */
+void string_builder_append(string_builder *b, const char *str, gssize len);
+
+/* like string_builder_append, but quote markup characters as entities */
+void string_builder_append_escaped(string_builder *b, const char *str, gssize len);
+
+/* append a printf-style formatted string */
+void string_builder_append_printf(string_builder *b, const char *format, ...) G_GNUC_PRINTF(2, 3);
+
+/* free the builder and return its string */
+char *string_builder_steal(string_builder *b);
+
+/* free the builder and its string */
+void string_builder_free(string_builder *b);
+
 /* replace all occurrences of the character needle with the character replacement in haystack */
 char *string_replace_char(char needle, char replacement, char *haystack);
 
@@ -30,5 +54,8 @@ char *string_to_path(char *string);
 /* convert time units (ms, s, m) to internal gint64 microseconds */
 gint64 string_to_time(const char *string);
 
+/* 64 bit hash of len bytes at data, chainable via seed */
+guint64 hash_data(const void *data, gsize len, guint64 seed);
+
 #endif
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -27,9 +27,12 @@
 
 #include "src/dbus.h"
 #include "src/dunst.h"
+#include "src/icon_cache.h"
+#include "src/icon_index.h"
 #include "src/markup.h"
 #include "src/notification.h"
 #include "src/queues.h"
+#include "src/rawimage.h"
 #include "src/settings.h"
 #include "src/utils.h"
 
@@ -57,10 +60,25 @@ typedef struct _colored_layout {
         PangoAttrList *attr;
         cairo_surface_t *icon;
         notification *n;
+
+        /* what the layout has been created from */
+        char *source;
+        const char *color_strings[3];
+        guint64 fingerprint;
+        int width;              /* available width, -1 if dynamic */
+        double dpi;
+
+        /* pixel size of the text, before calculate_dimensions rewraps it */
+        int text_w;
+        int text_h;
 } colored_layout;
 
 cairo_ctx_t cairo_ctx;
 
+/* the layouts of the last frame by notification, see r_create_layouts */
+static GHashTable *layout_cache = NULL;
+static colored_layout *xmore_cache = NULL;
+
 /* FIXME refactor setup teardown handlers into one setup and one teardown */
 static void x_shortcut_setup_error_handler(void);
 static int x_shortcut_tear_down_error_handler(void);
@@ -68,6 +86,7 @@ static void x_win_move(int width, int height);
 static void setopacity(Window win, unsigned long opacity);
 static void x_handle_click(XEvent ev);
 static void x_win_setup(void);
+static void x_win_apply_settings(void);
 
 static color_t x_color_hex_to_double(int hexValue)
 {
@@ -179,18 +198,29 @@ static void free_colored_layout(void *data)
         g_object_unref(cl->l);
         pango_attr_list_unref(cl->attr);
         g_free(cl->text);
+        g_free(cl->source);
         if (cl->icon) cairo_surface_destroy(cl->icon);
         g_free(cl);
 }
 
-static bool have_dynamic_width(void)
+/*
+ * Drop all cached layouts, e.g. because the font changed.
+ */
+static void r_flush_layouts(void)
 {
-        return (xctx.geometry.mask & WidthValue && xctx.geometry.w == 0);
+        if (layout_cache) {
+                g_hash_table_destroy(layout_cache);
+                layout_cache = NULL;
+        }
+        if (xmore_cache) {
+                free_colored_layout(xmore_cache);
+                xmore_cache = NULL;
+        }
 }
 
-static bool does_file_exist(const char *filename)
+static bool have_dynamic_width(void)
 {
-        return (access(filename, F_OK) != -1);
+        return (xctx.geometry.mask & WidthValue && xctx.geometry.w == 0);
 }
 
 static bool is_readable_file(const char *filename)
@@ -236,8 +266,7 @@ static dimension_t calculate_dimensions(GSList *layouts)
         int text_width = 0, total_width = 0;
         for (GSList *iter = layouts; iter; iter = iter->next) {
                 colored_layout *cl = iter->data;
-                int w=0,h=0;
-                pango_layout_get_pixel_size(cl->l, &w, &h);
+                int w = cl->text_w, h = cl->text_h;
                 if (cl->icon) {
                         h = MAX(cairo_image_surface_get_height(cl->icon), h);
                         w += cairo_image_surface_get_width(cl->icon) + settings.h_padding;
@@ -318,9 +347,69 @@ static GdkPixbuf *get_pixbuf_from_file(const char *icon_path)
         return pixbuf;
 }
 
-static GdkPixbuf *get_pixbuf_from_path(char *icon_path)
+/*
+ * Scale pixbuf down to max_icon_size and convert it to a cairo surface.
+ * Takes over the reference to pixbuf.
+ */
+static cairo_surface_t *icon_surface_from_pixbuf(GdkPixbuf *pixbuf)
 {
-        GdkPixbuf *pixbuf = NULL;
+        int w = gdk_pixbuf_get_width(pixbuf);
+        int h = gdk_pixbuf_get_height(pixbuf);
+        int larger = w > h ? w : h;
+        if (settings.max_icon_size && larger > settings.max_icon_size) {
+                GdkPixbuf *scaled;
+                if (w >= h) {
+                        scaled = gdk_pixbuf_scale_simple(pixbuf,
+                                        settings.max_icon_size,
+                                        (int) ((double) settings.max_icon_size / w * h),
+                                        GDK_INTERP_BILINEAR);
+                } else {
+                        scaled = gdk_pixbuf_scale_simple(pixbuf,
+                                        (int) ((double) settings.max_icon_size / h * w),
+                                        settings.max_icon_size,
+                                        GDK_INTERP_BILINEAR);
+                }
+                g_object_unref(pixbuf);
+                pixbuf = scaled;
+        }
+
+        cairo_surface_t *icon = gdk_pixbuf_to_cairo_surface(pixbuf);
+        g_object_unref(pixbuf);
+
+        if (cairo_surface_status(icon) != CAIRO_STATUS_SUCCESS) {
+                cairo_surface_destroy(icon);
+                return NULL;
+        }
+        return icon;
+}
+
+/*
+ * Load the icon at icon_path, decoding it only if it isn't cached yet.
+ */
+static cairo_surface_t *get_surface_from_file(const char *icon_path)
+{
+        cairo_surface_t *icon = icon_cache_lookup(icon_path, settings.max_icon_size);
+        if (icon)
+                return cairo_surface_reference(icon);
+
+        GdkPixbuf *pixbuf = get_pixbuf_from_file(icon_path);
+        if (!pixbuf)
+                return NULL;
+
+        icon = icon_surface_from_pixbuf(pixbuf);
+        if (icon) {
+                gsize bytes = (gsize) cairo_image_surface_get_stride(icon)
+                              * cairo_image_surface_get_height(icon);
+                icon_cache_insert(icon_path, settings.max_icon_size,
+                                  cairo_surface_reference(icon), bytes,
+                                  (GDestroyNotify) cairo_surface_destroy);
+        }
+        return icon;
+}
+
+static cairo_surface_t *get_surface_from_path(char *icon_path)
+{
+        cairo_surface_t *icon = NULL;
         gchar *uri_path = NULL;
         if (strlen(icon_path) > 0) {
                 if (g_str_has_prefix(icon_path, "file://")) {
@@ -331,36 +420,17 @@ static GdkPixbuf *get_pixbuf_from_path(char *icon_path)
                 }
                 /* absolute path? */
                 if (icon_path[0] == '/' || icon_path[0] == '~') {
-                        pixbuf = get_pixbuf_from_file(icon_path);
+                        icon = get_surface_from_file(icon_path);
                 }
-                /* search in icon_path */
-                if (pixbuf == NULL) {
-                        char *start = settings.icon_path,
-                             *end, *current_folder, *maybe_icon_path;
-                        do {
-                                end = strchr(start, ':');
-                                if (end == NULL) end = strchr(settings.icon_path, '\0'); /* end = end of string */
-
-                                current_folder = g_strndup(start, end - start);
-                                /* try svg */
-                                maybe_icon_path = g_strconcat(current_folder, "/", icon_path, ".svg", NULL);
-                                if (!does_file_exist(maybe_icon_path)) {
-                                        g_free(maybe_icon_path);
-                                        /* fallback to png */
-                                        maybe_icon_path = g_strconcat(current_folder, "/", icon_path, ".png", NULL);
-                                }
-                                g_free(current_folder);
-
-                                pixbuf = get_pixbuf_from_file(maybe_icon_path);
-                                g_free(maybe_icon_path);
-                                if (pixbuf != NULL) {
-                                        return pixbuf;
-                                }
-
-                                start = end + 1;
-                        } while (*(end) != '\0');
+                /* search in icon_path, falling back to the next file
+                 * of the icon if one can't be loaded */
+                if (icon == NULL) {
+                        char **indexed_paths = icon_index_lookup_all(icon_path);
+                        for (char **path = indexed_paths; path && *path && !icon; path++)
+                                icon = get_surface_from_file(*path);
+                        g_strfreev(indexed_paths);
                 }
-                if (pixbuf == NULL) {
+                if (icon == NULL) {
                         fprintf(stderr,
                                 "Could not load icon: '%s'\n", icon_path);
                 }
@@ -368,32 +438,68 @@ static GdkPixbuf *get_pixbuf_from_path(char *icon_path)
                         g_free(uri_path);
                 }
         }
-        return pixbuf;
+        return icon;
 }
 
-static GdkPixbuf *get_pixbuf_from_raw_image(const RawImage *raw_image)
+/*
+ * Convert raw_image straight into a cairo surface, scaling it down to
+ * max_icon_size in the same pass.
+ */
+static cairo_surface_t *convert_raw_image(const RawImage *raw_image)
 {
-        GdkPixbuf *pixbuf = NULL;
+        int width, height;
+        rawimage_scaled_size(raw_image, settings.max_icon_size, &width, &height);
 
-        pixbuf = gdk_pixbuf_new_from_data(raw_image->data,
-                                          GDK_COLORSPACE_RGB,
-                                          raw_image->has_alpha,
-                                          raw_image->bits_per_sample,
-                                          raw_image->width,
-                                          raw_image->height,
-                                          raw_image->rowstride,
-                                          NULL,
-                                          NULL);
+        cairo_surface_t *icon = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+        if (cairo_surface_status(icon) != CAIRO_STATUS_SUCCESS) {
+                cairo_surface_destroy(icon);
+                return NULL;
+        }
 
-        return pixbuf;
+        cairo_surface_flush(icon);
+        if (!rawimage_to_argb32(raw_image, width, height,
+                                (guint32 *) cairo_image_surface_get_data(icon),
+                                cairo_image_surface_get_stride(icon))) {
+                cairo_surface_destroy(icon);
+                return NULL;
+        }
+        cairo_surface_mark_dirty(icon);
+
+        return icon;
 }
 
-static PangoLayout *create_layout(cairo_t *c)
+/*
+ * Convert the raw image, sharing the surface between all notifications
+ * with an interned image of the same content.
+ */
+static cairo_surface_t *get_surface_from_raw_image(const RawImage *raw_image)
 {
-        screen_info *screen = get_active_screen();
+        if (!raw_image->id)
+                return convert_raw_image(raw_image);
+
+        char *key = g_strdup_printf("image-data://%" G_GUINT64_FORMAT, raw_image->id);
+        cairo_surface_t *icon = icon_cache_lookup(key, settings.max_icon_size);
+        if (icon) {
+                g_free(key);
+                return cairo_surface_reference(icon);
+        }
+
+        icon = convert_raw_image(raw_image);
+        if (icon) {
+                gsize bytes = (gsize) cairo_image_surface_get_stride(icon)
+                              * cairo_image_surface_get_height(icon);
+                icon_cache_insert(key, settings.max_icon_size,
+                                  cairo_surface_reference(icon), bytes,
+                                  (GDestroyNotify) cairo_surface_destroy);
+        }
+        g_free(key);
+        return icon;
+}
 
+static PangoLayout *create_layout(cairo_t *c, double dpi)
+{
         PangoContext *context = pango_cairo_create_context(c);
-        pango_cairo_context_set_resolution(context, get_dpi_for_screen(screen));
+        pango_cairo_context_set_resolution(context, dpi);
 
         PangoLayout *layout = pango_layout_new(context);
 
@@ -402,10 +508,10 @@ static PangoLayout *create_layout(cairo_t *c)
         return layout;
 }
 
-static colored_layout *r_init_shared(cairo_t *c, notification *n)
+static colored_layout *r_init_shared(cairo_t *c, notification *n, const char *source, int width, double dpi)
 {
         colored_layout *cl = g_malloc(sizeof(colored_layout));
-        cl->l = create_layout(c);
+        cl->l = create_layout(c, dpi);
 
         if (!settings.word_wrap) {
                 PangoEllipsizeMode ellipsize;
@@ -425,47 +531,15 @@ static colored_layout *r_init_shared(cairo_t *c, notification *n)
                 pango_layout_set_ellipsize(cl->l, ellipsize);
         }
 
-        GdkPixbuf *pixbuf = NULL;
+        cl->icon = NULL;
 
         if (n->raw_icon &&
             settings.icon_position != icons_off) {
 
-                pixbuf = get_pixbuf_from_raw_image(n->raw_icon);
+                cl->icon = get_surface_from_raw_image(n->raw_icon);
 
         } else if (n->icon && settings.icon_position != icons_off) {
-                pixbuf = get_pixbuf_from_path(n->icon);
-        }
-
-        if (pixbuf != NULL) {
-                int w = gdk_pixbuf_get_width(pixbuf);
-                int h = gdk_pixbuf_get_height(pixbuf);
-                int larger = w > h ? w : h;
-                if (settings.max_icon_size && larger > settings.max_icon_size) {
-                        GdkPixbuf *scaled;
-                        if (w >= h) {
-                                scaled = gdk_pixbuf_scale_simple(pixbuf,
-                                                settings.max_icon_size,
-                                                (int) ((double) settings.max_icon_size / w * h),
-                                                GDK_INTERP_BILINEAR);
-                        } else {
-                                scaled = gdk_pixbuf_scale_simple(pixbuf,
-                                                (int) ((double) settings.max_icon_size / h * w),
-                                                settings.max_icon_size,
-                                                GDK_INTERP_BILINEAR);
-                        }
-                        g_object_unref(pixbuf);
-                        pixbuf = scaled;
-                }
-
-                cl->icon = gdk_pixbuf_to_cairo_surface(pixbuf);
-                g_object_unref(pixbuf);
-        } else {
-                cl->icon = NULL;
-        }
-
-        if (cl->icon && cairo_surface_status(cl->icon) != CAIRO_STATUS_SUCCESS) {
-                cairo_surface_destroy(cl->icon);
-                cl->icon = NULL;
+                cl->icon = get_surface_from_path(n->icon);
         }
 
         cl->fg = x_string_to_color_t(n->color_strings[ColFG]);
@@ -474,10 +548,14 @@ static colored_layout *r_init_shared(cairo_t *c, notification *n)
 
         cl->n = n;
 
-        dimension_t dim = calculate_dimensions(NULL);
-        int width = dim.w;
+        cl->source = g_strdup(source);
+        for (int i = 0; i < 3; i++)
+                cl->color_strings[i] = n->color_strings[i];
+        cl->fingerprint = n->fingerprint;
+        cl->width = width;
+        cl->dpi = dpi;
 
-        if (have_dynamic_width()) {
+        if (width < 0) {
                 r_setup_pango_layout(cl->l, -1);
         } else {
                 width -= 2 * settings.h_padding;
@@ -489,19 +567,54 @@ static colored_layout *r_init_shared(cairo_t *c, notification *n)
         return cl;
 }
 
-static colored_layout *r_create_layout_for_xmore(cairo_t *c, notification *n, int qlen)
+/*
+ * Check whether cl can be drawn for n again, without having to shape
+ * the text and to load the icon anew.
+ */
+static bool r_layout_is_current(const colored_layout *cl, const notification *n,
+                                const char *source, int width, double dpi)
+{
+        if (cl->n != n || cl->fingerprint != n->fingerprint
+            || cl->width != width || cl->dpi != dpi)
+                return false;
+
+        for (int i = 0; i < 3; i++)
+                if (g_strcmp0(cl->color_strings[i], n->color_strings[i]) != 0)
+                        return false;
+
+        return strcmp(cl->source, source) == 0;
+}
+
+static void r_measure_layout(colored_layout *cl)
 {
-        colored_layout *cl = r_init_shared(c, n);
-        cl->text = g_strdup_printf("(%d more)", qlen);
+        pango_layout_get_pixel_size(cl->l, &cl->text_w, &cl->text_h);
+}
+
+static colored_layout *r_create_layout_for_xmore(cairo_t *c, notification *n, int qlen, int width, double dpi)
+{
+        char *text = g_strdup_printf("(%d more)", qlen);
+
+        if (xmore_cache && r_layout_is_current(xmore_cache, n, text, width, dpi)) {
+                g_free(text);
+                return xmore_cache;
+        }
+        if (xmore_cache)
+                free_colored_layout(xmore_cache);
+
+        colored_layout *cl = r_init_shared(c, n, text, width, dpi);
+        cl->text = text;
         cl->attr = NULL;
         pango_layout_set_text(cl->l, cl->text, -1);
+        r_measure_layout(cl);
+
+        xmore_cache = cl;
         return cl;
 }
 
-static colored_layout *r_create_layout_from_notification(cairo_t *c, notification *n)
+static colored_layout *r_create_layout_from_notification(cairo_t *c, notification *n, int width, double dpi)
 {
 
-        colored_layout *cl = r_init_shared(c, n);
+        colored_layout *cl = r_init_shared(c, n, n->text_to_render, width, dpi);
 
         /* markup */
         GError *err = NULL;
@@ -522,8 +635,25 @@ static colored_layout *r_create_layout_from_notification(cairo_t *c, notificatio
                 g_error_free(err);
         }
 
+        r_measure_layout(cl);
+        return cl;
+}
+
+/*
+ * Return the layout of n from the last frame, if it's still current,
+ * or create a new one.
+ */
+static colored_layout *r_get_layout(cairo_t *c, notification *n, int width, double dpi)
+{
+        colored_layout *cl = layout_cache ? g_hash_table_lookup(layout_cache, n) : NULL;
+
+        if (cl && r_layout_is_current(cl, n, n->text_to_render, width, dpi)) {
+                g_hash_table_steal(layout_cache, n);
+        } else {
+                cl = r_create_layout_from_notification(c, n, width, dpi);
+        }
 
-        pango_layout_get_pixel_size(cl->l, NULL, &(n->displayed_height));
+        n->displayed_height = cl->text_h;
         if (cl->icon) n->displayed_height = MAX(cairo_image_surface_get_height(cl->icon), n->displayed_height);
         n->displayed_height = MAX(settings.notification_height, n->displayed_height + settings.padding * 2);
 
@@ -531,13 +661,26 @@ static colored_layout *r_create_layout_from_notification(cairo_t *c, notificatio
         return cl;
 }
 
+/*
+ * Create the layouts for the displayed notifications.
+ *
+ * The layouts are kept until the next frame, where they get reused
+ * as long as the text, the width, the DPI and the colors of their
+ * notification stay the same. Layouts of notifications, which are not
+ * displayed anymore, get freed.
+ */
 static GSList *r_create_layouts(cairo_t *c)
 {
         GSList *layouts = NULL;
+        GHashTable *cache = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                  NULL, free_colored_layout);
 
         int qlen = queues_length_waiting();
         bool xmore_is_needed = qlen > 0 && settings.indicate_hidden;
 
+        int width = have_dynamic_width() ? -1 : calculate_dimensions(NULL).w;
+        double dpi = get_dpi_for_screen(get_active_screen());
+
         notification *last = NULL;
         for (const GList *iter = queues_get_displayed();
                         iter; iter = iter->next)
@@ -552,22 +695,30 @@ static GSList *r_create_layouts(cairo_t *c)
                         g_free(n->text_to_render);
                         n->text_to_render = new_ttr;
                 }
-                layouts = g_slist_append(layouts,
-                                r_create_layout_from_notification(c, n));
+                colored_layout *cl = r_get_layout(c, n, width, dpi);
+                g_hash_table_insert(cache, n, cl);
+                layouts = g_slist_append(layouts, cl);
         }
 
+        if (layout_cache)
+                g_hash_table_destroy(layout_cache);
+        layout_cache = cache;
+
         if (xmore_is_needed && xctx.geometry.h != 1) {
                 /* append xmore message as new message */
                 layouts = g_slist_append(layouts,
-                        r_create_layout_for_xmore(c, last, qlen));
+                        r_create_layout_for_xmore(c, last, qlen, width, dpi));
         }
 
         return layouts;
 }
 
+/*
+ * Free the list of layouts. The layouts themselves stay cached.
+ */
 static void r_free_layouts(GSList *layouts)
 {
-        g_slist_free_full(layouts, free_colored_layout);
+        g_slist_free(layouts);
 }
 
 static dimension_t x_render_layout(cairo_t *c, colored_layout *cl, colored_layout *cl_next, dimension_t dim, bool first, bool last)
@@ -953,6 +1104,9 @@ static void x_handle_click(XEvent ev)
 
 void x_free(void)
 {
+        r_flush_layouts();
+        icon_cache_clear();
+        icon_index_free();
         cairo_surface_destroy(cairo_ctx.surface);
         cairo_destroy(cairo_ctx.context);
 
@@ -961,18 +1115,10 @@ void x_free(void)
 }
 
 /*
- * Setup X11 stuff
+ * Set up the shortcuts, colors and geometry from the settings.
  */
-void x_setup(void)
+static void x_apply_settings(void)
 {
-
-        /* initialize xctx.dc, font, keyboard, colors */
-        if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
-                fputs("no locale support\n", stderr);
-        if (!(xctx.dpy = XOpenDisplay(NULL))) {
-                die("cannot open display\n", EXIT_FAILURE);
-        }
-
         x_shortcut_init(&settings.close_ks);
         x_shortcut_init(&settings.close_all_ks);
         x_shortcut_init(&settings.history_ks);
@@ -1009,6 +1155,7 @@ void x_setup(void)
                 xctx.color_strings[ColFrame][URG_CRIT] = settings.frame_color;
 
         /* parse and set xctx.geometry and monitor position */
+        xctx.geometry = (dimension_t) { 0 };
         if (settings.geom[0] == '-') {
                 xctx.geometry.negative_width = true;
                 settings.geom++;
@@ -1020,6 +1167,9 @@ void x_setup(void)
                                             &xctx.geometry.x, &xctx.geometry.y,
                                             &xctx.geometry.w, &xctx.geometry.h);
 
+        icon_cache_set_limit(settings.icon_cache_memory);
+        icon_index_build(settings.icon_path);
+
         /* calculate maximum notification count and push information to queue */
         if (xctx.geometry.h == 0) {
                 queues_displayed_limit(0);
@@ -1030,6 +1180,22 @@ void x_setup(void)
         } else {
                 queues_displayed_limit(xctx.geometry.h);
         }
+}
+
+/*
+ * Setup X11 stuff
+ */
+void x_setup(void)
+{
+
+        /* initialize xctx.dc, font, keyboard, colors */
+        if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
+                fputs("no locale support\n", stderr);
+        if (!(xctx.dpy = XOpenDisplay(NULL))) {
+                die("cannot open display\n", EXIT_FAILURE);
+        }
+
+        x_apply_settings();
 
         xctx.screensaver_info = XScreenSaverAllocInfo();
 
@@ -1128,6 +1294,17 @@ static void x_win_setup(void)
                                  CWOverrideRedirect | CWBackPixmap | CWEventMask,
                                  &wa);
 
+        x_win_apply_settings();
+}
+
+/*
+ * Set the window properties and the events to follow the focus
+ * according to the settings.
+ */
+static void x_win_apply_settings(void)
+{
+        Window root = RootWindow(xctx.dpy, DefaultScreen(xctx.dpy));
+
         x_set_wm(xctx.win);
         settings.transparency =
             settings.transparency > 100 ? 100 : settings.transparency;
@@ -1138,9 +1315,28 @@ static void x_win_setup(void)
         if (settings.f_mode != FOLLOW_NONE) {
                 long root_event_mask = FocusChangeMask | PropertyChangeMask;
                 XSelectInput(xctx.dpy, root, root_event_mask);
+        } else {
+                XSelectInput(xctx.dpy, root, NoEventMask);
         }
 }
 
+/*
+ * Apply reloaded settings, keeping the window and the connection to
+ * the X server. The shortcuts of the old settings have to be
+ * ungrabbed before the settings got reloaded.
+ */
+void x_reload(void)
+{
+        x_apply_settings();
+        x_win_apply_settings();
+
+        pango_font_description_free(cairo_ctx.desc);
+        cairo_ctx.desc = pango_font_description_from_string(settings.font);
+        r_flush_layouts();
+
+        x_shortcut_grab(&settings.history_ks);
+}
+
 /*
  * Show the window and grab shortcuts.
  */
@@ -1187,6 +1383,8 @@ void x_win_hide()
         XUnmapWindow(xctx.dpy, xctx.win);
         XFlush(xctx.dpy);
         xctx.visible = false;
+
+        r_flush_layouts();
 }
 
 /*
@@ -1310,6 +1508,10 @@ void x_shortcut_init(keyboard_shortcut *ks)
         if (ks == NULL || ks->str == NULL)
                 return;
 
+        ks->code = 0;
+        ks->sym = NoSymbol;
+        ks->mask = 0;
+
         if (!strcmp(ks->str, "none") || (!strcmp(ks->str, ""))) {
                 ks->is_valid = false;
                 return;
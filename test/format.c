@@ -0,0 +1,89 @@
+#include "greatest.h"
+#include "src/format.h"
+
+#include <glib.h>
+
+static notification *n = NULL;
+
+static char *expand(const char *format)
+{
+        return format_expand(format_compile(format), n);
+}
+
+TEST test_format_fields(void)
+{
+        char *msg = expand("%a: %s %b %I %i %p %n");
+        ASSERT_STR_EQ("app: summary &lt;b&gt;body&lt;/b&gt; icon.png /path/icon.png [ 42%] 42", msg);
+        g_free(msg);
+
+        n->progress = -1;
+        msg = expand("%s%p%n%b");
+        ASSERT_STR_EQ("summary&lt;b&gt;body&lt;/b&gt;", msg);
+        g_free(msg);
+        n->progress = 42;
+
+        PASS();
+}
+
+TEST test_format_literals(void)
+{
+        char *msg = expand("");
+        ASSERT_STR_EQ("", msg);
+        g_free(msg);
+
+        msg = expand("100%% %s\\n%%s");
+        ASSERT_STR_EQ("100% summary\n%s", msg);
+        g_free(msg);
+
+        /* unknown fields and trailing percent signs are kept */
+        msg = expand("%x %s %");
+        ASSERT_STR_EQ("%x summary %", msg);
+        g_free(msg);
+
+        PASS();
+}
+
+TEST test_format_no_recursion(void)
+{
+        char *summary = n->summary;
+        n->summary = "%b";
+
+        char *msg = expand("%s %b");
+        ASSERT_STR_EQ("%b &lt;b&gt;body&lt;/b&gt;", msg);
+        g_free(msg);
+
+        n->summary = summary;
+        PASS();
+}
+
+TEST test_format_cache(void)
+{
+        const char *format = "<b>%s</b>";
+        char *copy = g_strdup(format);
+
+        ASSERT_EQ(format_compile(format), format_compile(copy));
+        ASSERT(format_compile(format) != format_compile("%s"));
+
+        g_free(copy);
+        PASS();
+}
+
+SUITE(suite_format)
+{
+        n = notification_create();
+        n->appname = g_strdup("app");
+        n->summary = g_strdup("summary");
+        n->body = g_strdup("<b>body</b>");
+        n->icon = g_strdup("/path/icon.png");
+        n->markup = MARKUP_NO;
+        n->progress = 42;
+
+        RUN_TEST(test_format_fields);
+        RUN_TEST(test_format_literals);
+        RUN_TEST(test_format_no_recursion);
+        RUN_TEST(test_format_cache);
+
+        notification_free(n);
+        format_teardown();
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,232 @@
+#include "greatest.h"
+#include "src/history_log.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static char *dir = NULL;
+static char *path = NULL;
+
+static notification *test_notification(const char *summary, enum urgency urgency)
+{
+        notification *n = notification_create();
+        n->appname = g_strdup("history_log");
+        n->summary = g_strdup(summary);
+        n->body = g_strdup("body");
+        n->category = g_strdup("");
+        n->urgency = urgency;
+        n->markup = MARKUP_NO;
+        n->progress = -1;
+        n->timeout = 10 * G_USEC_PER_SEC;
+        n->timestamp = g_get_monotonic_time();
+
+        return n;
+}
+
+TEST test_history_log_replay(void)
+{
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(0, history_log_length());
+
+        notification *a = test_notification("a", URG_LOW);
+        notification *b = test_notification("b", URG_CRIT);
+        notification *c = test_notification("c", URG_NORM);
+
+        unsigned char pixels[6] = { 1, 2, 3, 4, 5, 6 };
+        b->raw_icon = g_malloc(sizeof(RawImage));
+        *b->raw_icon = (RawImage) { 2, 1, 6, 0, 8, 3, g_memdup(pixels, sizeof(pixels)) };
+        b->icon = NULL;
+
+        history_log_push(a);
+        history_log_push(b);
+        history_log_push(c);
+        history_log_pop();
+        history_log_close();
+
+        /* c got popped again */
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(2, history_log_length());
+
+        notification *n = history_log_take();
+        ASSERT(n);
+        ASSERT_STR_EQ("b", n->summary);
+        ASSERT_STR_EQ("history_log", n->appname);
+        ASSERT_STR_EQ("body", n->body);
+        ASSERT_EQ(NULL, n->icon);
+        ASSERT_EQ(URG_CRIT, n->urgency);
+        ASSERT_EQ(b->fingerprint, n->fingerprint);
+        ASSERT(n->raw_icon);
+        ASSERT_EQ(2, n->raw_icon->width);
+        ASSERT_MEM_EQ(pixels, n->raw_icon->data, sizeof(pixels));
+        notification_free(n);
+
+        n = history_log_take();
+        ASSERT(n);
+        ASSERT_STR_EQ("a", n->summary);
+        ASSERT_EQ(NULL, n->raw_icon);
+        notification_free(n);
+
+        ASSERT_EQ(NULL, history_log_take());
+        history_log_close();
+
+        /* only the newest ones get indexed */
+        ASSERT(history_log_open(path, 1));
+        ASSERT_EQ(1, history_log_length());
+        n = history_log_take();
+        ASSERT_STR_EQ("b", n->summary);
+        notification_free(n);
+        history_log_close();
+
+        notification_free(a);
+        notification_free(b);
+        notification_free(c);
+        PASS();
+}
+
+TEST test_history_log_truncated(void)
+{
+        ASSERT(history_log_open(path, 0));
+        unsigned int length = history_log_length();
+        history_log_close();
+
+        /* a record cut off in the middle of a write */
+        FILE *f = fopen(path, "a");
+        ASSERT(f);
+        fwrite("\x40\x00\x00\x00\x01\x02", 1, 6, f);
+        fclose(f);
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(length, history_log_length());
+
+        notification *n = test_notification("d", URG_NORM);
+        history_log_push(n);
+        notification_free(n);
+        history_log_close();
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(length + 1, history_log_length());
+        n = history_log_take();
+        ASSERT_STR_EQ("d", n->summary);
+        notification_free(n);
+        history_log_close();
+
+        PASS();
+}
+
+TEST test_history_log_compact(void)
+{
+        ASSERT(history_log_open(path, 0));
+        unsigned int length = history_log_length();
+
+        notification *n = test_notification("e", URG_NORM);
+        for (int i = 0; i < 100; i++) {
+                history_log_push(n);
+                history_log_pop();
+        }
+        notification_free(n);
+        history_log_close();
+
+        /* the log got compacted while it was written */
+        GStatBuf st;
+        ASSERT_EQ(0, g_stat(path, &st));
+        ASSERT(st.st_size < 4096);
+
+        /* the reopened log only holds the live records */
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(length, history_log_length());
+        history_log_close();
+
+        ASSERT_EQ(0, g_stat(path, &st));
+        ASSERT(st.st_size < 1024);
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(length, history_log_length());
+        n = history_log_take();
+        ASSERT_STR_EQ("d", n->summary);
+        notification_free(n);
+        history_log_close();
+
+        PASS();
+}
+
+TEST test_history_log_drop(void)
+{
+        ASSERT(history_log_open(path, 0));
+        unsigned int length = history_log_length();
+
+        notification *f = test_notification("f", URG_NORM);
+        notification *g = test_notification("g", URG_NORM);
+
+        /* the indexed notifications are older than f and g */
+        history_log_push(f);
+        history_log_push(g);
+        history_log_drop(length + 1);
+        ASSERT_EQ(0, history_log_length());
+        history_log_close();
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(1, history_log_length());
+
+        /* trimming the index drops g in the log as well */
+        history_log_push(f);
+        history_log_trim(0);
+        ASSERT_EQ(0, history_log_length());
+        history_log_close();
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(1, history_log_length());
+        notification *n = history_log_take();
+        ASSERT_STR_EQ("f", n->summary);
+        notification_free(n);
+        history_log_pop();
+        history_log_close();
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(0, history_log_length());
+        history_log_close();
+
+        notification_free(f);
+        notification_free(g);
+        PASS();
+}
+
+TEST test_history_log_invalid(void)
+{
+        char *invalid = g_build_filename(dir, "invalid", NULL);
+        ASSERT(g_file_set_contents(invalid, "not a log", -1, NULL));
+
+        ASSERT_FALSE(history_log_open(invalid, 0));
+        ASSERT_EQ(0, history_log_length());
+        ASSERT_EQ(NULL, history_log_take());
+
+        g_unlink(invalid);
+        g_free(invalid);
+        PASS();
+}
+
+SUITE(suite_history_log)
+{
+        dir = g_build_filename(g_get_tmp_dir(), "dunst-test-XXXXXX", NULL);
+        if (!g_mkdtemp(dir)) {
+                fprintf(stderr, "Unable to create %s\n", dir);
+                return;
+        }
+        path = g_build_filename(dir, "dunst", "history", NULL);
+
+        RUN_TEST(test_history_log_replay);
+        RUN_TEST(test_history_log_truncated);
+        RUN_TEST(test_history_log_compact);
+        RUN_TEST(test_history_log_drop);
+        RUN_TEST(test_history_log_invalid);
+
+        g_unlink(path);
+        char *parent = g_path_get_dirname(path);
+        g_rmdir(parent);
+        g_rmdir(dir);
+        g_free(parent);
+        g_free(path);
+        g_free(dir);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
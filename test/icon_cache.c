@@ -0,0 +1,97 @@
+#include "greatest.h"
+#include "src/icon_cache.h"
+
+#include <glib.h>
+
+static int freed = 0;
+
+static void count_free(gpointer data)
+{
+        freed++;
+        g_free(data);
+}
+
+TEST test_icon_cache_lookup(void)
+{
+        guint64 hits, misses;
+        gsize bytes;
+
+        icon_cache_insert("/a.png", 32, g_strdup("a32"), 10, count_free);
+        icon_cache_insert("/a.png", 64, g_strdup("a64"), 20, count_free);
+
+        ASSERT_STR_EQ("a32", icon_cache_lookup("/a.png", 32));
+        ASSERT_STR_EQ("a64", icon_cache_lookup("/a.png", 64));
+        ASSERT_EQ(NULL, icon_cache_lookup("/a.png", 16));
+        ASSERT_EQ(NULL, icon_cache_lookup("/b.png", 32));
+
+        icon_cache_stats(&hits, &misses, &bytes);
+        ASSERT_EQ(2, hits);
+        ASSERT_EQ(2, misses);
+        ASSERT_EQ(30, bytes);
+
+        /* replacing an icon frees the old one */
+        icon_cache_insert("/a.png", 32, g_strdup("new"), 5, count_free);
+        ASSERT_EQ(1, freed);
+        ASSERT_STR_EQ("new", icon_cache_lookup("/a.png", 32));
+        icon_cache_stats(&hits, &misses, &bytes);
+        ASSERT_EQ(25, bytes);
+
+        icon_cache_clear();
+        ASSERT_EQ(3, freed);
+        ASSERT_EQ(NULL, icon_cache_lookup("/a.png", 32));
+        PASS();
+}
+
+TEST test_icon_cache_evict(void)
+{
+        guint64 hits, misses;
+        gsize bytes;
+
+        icon_cache_insert("/a.png", 32, g_strdup("a"), 40, count_free);
+        icon_cache_insert("/b.png", 32, g_strdup("b"), 40, count_free);
+
+        /* a is used more recently than b now */
+        ASSERT(icon_cache_lookup("/a.png", 32));
+        icon_cache_insert("/c.png", 32, g_strdup("c"), 40, count_free);
+
+        ASSERT_EQ(1, freed);
+        ASSERT_EQ(NULL, icon_cache_lookup("/b.png", 32));
+        ASSERT(icon_cache_lookup("/a.png", 32));
+        ASSERT(icon_cache_lookup("/c.png", 32));
+
+        /* icons larger than the whole cache are not kept */
+        icon_cache_insert("/d.png", 32, g_strdup("d"), 101, count_free);
+        ASSERT_EQ(2, freed);
+        ASSERT_EQ(NULL, icon_cache_lookup("/d.png", 32));
+
+        icon_cache_set_limit(50);
+        ASSERT_EQ(3, freed);
+        ASSERT_EQ(NULL, icon_cache_lookup("/a.png", 32));
+        icon_cache_stats(&hits, &misses, &bytes);
+        ASSERT_EQ(40, bytes);
+
+        icon_cache_set_limit(0);
+        ASSERT_EQ(4, freed);
+        icon_cache_stats(&hits, &misses, &bytes);
+        ASSERT_EQ(0, bytes);
+        PASS();
+}
+
+static void reset(void *data)
+{
+        icon_cache_clear();
+        icon_cache_set_limit(100);
+        freed = 0;
+}
+
+SUITE(suite_icon_cache)
+{
+        SET_SETUP(reset, NULL);
+
+        RUN_TEST(test_icon_cache_lookup);
+        RUN_TEST(test_icon_cache_evict);
+
+        SET_SETUP(NULL, NULL);
+        icon_cache_clear();
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,181 @@
+#include "greatest.h"
+#include "src/icon_index.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+static char *dir = NULL;
+static char *first = NULL;
+static char *second = NULL;
+
+static void touch(const char *folder, const char *file)
+{
+        char *path = g_build_filename(folder, file, NULL);
+        g_file_set_contents(path, "", 0, NULL);
+        g_free(path);
+}
+
+static void rm(const char *folder, const char *file)
+{
+        char *path = g_build_filename(folder, file, NULL);
+        g_unlink(path);
+        g_free(path);
+}
+
+TEST test_icon_index_lookup(void)
+{
+        char *path;
+
+        /* the first folder wins */
+        path = icon_index_lookup("both");
+        ASSERT(path);
+        ASSERT(g_str_has_prefix(path, first));
+        g_free(path);
+
+        /* svg files are preferred within a folder */
+        path = icon_index_lookup("vector");
+        ASSERT(path);
+        ASSERT(g_str_has_prefix(path, second));
+        ASSERT(g_str_has_suffix(path, "vector.svg"));
+        g_free(path);
+
+        path = icon_index_lookup("bitmap");
+        ASSERT(g_str_has_suffix(path, "bitmap.png"));
+        g_free(path);
+
+        ASSERT_EQ(NULL, icon_index_lookup("missing"));
+        ASSERT_EQ(NULL, icon_index_lookup("notes"));
+        ASSERT_EQ(NULL, icon_index_lookup("sub"));
+
+        /* names with a folder get searched for in the folders */
+        path = icon_index_lookup("sub/nested");
+        ASSERT(path);
+        ASSERT(g_str_has_suffix(path, "sub/nested.png"));
+        g_free(path);
+        PASS();
+}
+
+TEST test_icon_index_invalidate(void)
+{
+        char *path;
+
+        /* the index doesn't look at the folders again by itself */
+        touch(first, "late.png");
+        ASSERT_EQ(NULL, icon_index_lookup("late"));
+
+        icon_index_invalidate();
+        path = icon_index_lookup("late");
+        ASSERT(path);
+        g_free(path);
+
+        rm(first, "both.png");
+        icon_index_invalidate();
+        path = icon_index_lookup("both");
+        ASSERT(g_str_has_prefix(path, second));
+        g_free(path);
+
+        touch(first, "both.png");
+        PASS();
+}
+
+TEST test_icon_index_rebuild(void)
+{
+        char *path;
+
+        /* building the same path again keeps the index */
+        touch(second, "unseen.png");
+        char *same = g_strdup_printf("%s:%s", first, second);
+        icon_index_build(same);
+        g_free(same);
+        ASSERT_EQ(NULL, icon_index_lookup("unseen"));
+
+        char *swapped = g_strdup_printf("%s:%s", second, first);
+        icon_index_build(swapped);
+        g_free(swapped);
+
+        path = icon_index_lookup("both");
+        ASSERT(g_str_has_prefix(path, second));
+        g_free(path);
+        path = icon_index_lookup("unseen");
+        ASSERT(path);
+        g_free(path);
+
+        icon_index_free();
+        ASSERT_EQ(NULL, icon_index_lookup("both"));
+        PASS();
+}
+
+TEST test_icon_index_lookup_all(void)
+{
+        char **paths;
+
+        /* all files of an icon, to fall back on when one is broken */
+        paths = icon_index_lookup_all("both");
+        ASSERT(paths);
+        ASSERT_EQ(2, g_strv_length(paths));
+        ASSERT(g_str_has_prefix(paths[0], first));
+        ASSERT(g_str_has_prefix(paths[1], second));
+        g_strfreev(paths);
+
+        paths = icon_index_lookup_all("vector");
+        ASSERT_EQ(2, g_strv_length(paths));
+        ASSERT(g_str_has_suffix(paths[0], "vector.svg"));
+        ASSERT(g_str_has_suffix(paths[1], "vector.png"));
+        g_strfreev(paths);
+
+        paths = icon_index_lookup_all("sub/nested");
+        ASSERT_EQ(1, g_strv_length(paths));
+        g_strfreev(paths);
+
+        ASSERT_EQ(NULL, icon_index_lookup_all("missing"));
+        ASSERT_EQ(NULL, icon_index_lookup_all("sub/missing"));
+        PASS();
+}
+
+SUITE(suite_icon_index)
+{
+        dir = g_build_filename(g_get_tmp_dir(), "dunst-test-XXXXXX", NULL);
+        if (!g_mkdtemp(dir)) {
+                fprintf(stderr, "Unable to create %s\n", dir);
+                return;
+        }
+        first = g_build_filename(dir, "first", NULL);
+        second = g_build_filename(dir, "second", NULL);
+        char *sub = g_build_filename(second, "sub", NULL);
+        g_mkdir_with_parents(first, 0700);
+        g_mkdir_with_parents(sub, 0700);
+
+        const char *first_files[] = { "both.png", "notes.txt" };
+        const char *second_files[] = { "both.svg", "vector.png", "vector.svg", "bitmap.png", "sub/nested.png" };
+        for (int i = 0; i < G_N_ELEMENTS(first_files); i++)
+                touch(first, first_files[i]);
+        for (int i = 0; i < G_N_ELEMENTS(second_files); i++)
+                touch(second, second_files[i]);
+
+        char *icon_path = g_strdup_printf("%s:%s", first, second);
+        icon_index_build(icon_path);
+        g_free(icon_path);
+
+        RUN_TEST(test_icon_index_lookup);
+        RUN_TEST(test_icon_index_lookup_all);
+        RUN_TEST(test_icon_index_invalidate);
+        RUN_TEST(test_icon_index_rebuild);
+
+        icon_index_free();
+        for (int i = 0; i < G_N_ELEMENTS(first_files); i++)
+                rm(first, first_files[i]);
+        for (int i = 0; i < G_N_ELEMENTS(second_files); i++)
+                rm(second, second_files[i]);
+        rm(first, "late.png");
+        rm(second, "unseen.png");
+        g_rmdir(sub);
+        g_rmdir(first);
+        g_rmdir(second);
+        g_rmdir(dir);
+        g_free(sub);
+        g_free(first);
+        g_free(second);
+        g_free(dir);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -21,6 +21,8 @@ TEST test_markup_strip(void)
         g_free(ptr);
         ASSERT_STR_EQ(">A  ", (ptr=markup_strip(g_strdup(">A <img> <string"))));
         g_free(ptr);
+        ASSERT_STR_EQ("<&&&amp", (ptr=markup_strip(g_strdup("&l<b>t;&&amp;&amp"))));
+        g_free(ptr);
 
         PASS();
 }
@@ -36,6 +38,8 @@ TEST test_markup_transform(void)
         g_free(ptr);
         ASSERT_STR_EQ("<i>foo</i>\nbar\nbaz", (ptr=markup_transform(g_strdup("<i>foo</i><br>bar\nbaz"), MARKUP_FULL)));
         g_free(ptr);
+        ASSERT_STR_EQ("a\nb\nc&lt;&amp;lt", (ptr=markup_transform(g_strdup("a<br/>b<br />c<br/ ><b>&lt;</b>&lt"), MARKUP_STRIP)));
+        g_free(ptr);
 
         settings.ignore_newline = true;
         ASSERT_STR_EQ("&lt;i&gt;foo&lt;/i&gt;&lt;br&gt;bar baz", (ptr=markup_transform(g_strdup("<i>foo</i><br>bar\nbaz"), MARKUP_NO)));
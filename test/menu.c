@@ -0,0 +1,159 @@
+#include "greatest.h"
+#include "src/menu.h"
+#include "src/utils.h"
+
+#include <glib.h>
+#include <locale.h>
+#include <regex.h>
+#include <stdbool.h>
+
+/* the regular expression, which was used to find urls before */
+static const char *reference_pattern =
+        "\\b(https?://|ftps?://|news://|mailto:|file://|www\\.)"
+        "[-[:alnum:]_\\@;/?:&=%$.+!*\x27,~#]*"
+        "(\\([-[:alnum:]_\\@;/?:&=%$.+!*\x27,~#]*\\)|[-[:alnum:]_\\@;/?:&=%$+*~])+";
+static regex_t reference_regex;
+
+static char *reference_extract_urls(const char *to_match)
+{
+        char *urls = NULL;
+        const char *p = to_match;
+        regmatch_t m;
+
+        while (regexec(&reference_regex, p, 1, &m, 0) == 0 && m.rm_so != -1) {
+                char *match = g_strndup(p + m.rm_so, m.rm_eo - m.rm_so);
+                urls = string_append(urls, match, "\n");
+                g_free(match);
+
+                p += m.rm_eo;
+        }
+
+        return urls;
+}
+
+static const char *corpus[] = {
+        "",
+        "no urls here",
+        "http://example.com",
+        "Visit https://example.com/path?query=1&b=2#anchor now",
+        "HTTP://EXAMPLE.COM/UPPER and WwW.Mixed.Case",
+        "two: ftp://a.b/c ftps://d.e/f",
+        "news://news.example.com/group mailto:user@example.com file:///etc/passwd",
+        "end with dot http://example.com. or comma http://example.com, here",
+        "quoted 'http://example.com/a' and \"www.example.com\"",
+        "wiki http://en.wikipedia.org/wiki/Foo_(bar) (http://example.com)",
+        "groups http://a.b/(c)(d)e(f.g)h. http://a.b/(unclosed",
+        "nested http://a.b/((c)) and http://a.b/(c)).",
+        "prefix only http:// www. mailto: file://",
+        "no boundary xhttp://example.com _www.example.com 1www.example.com",
+        "boundaries -http://a.b /www.c.d (www.e.f) <https://g.h>",
+        "adjacent http://a.bhttp://c.d www.a.b,www.c.d",
+        "all chars http://a.b/-_\\@;/?:&=%$.+!*',~#x",
+        "trailing http://a.b/!!! http://a.b/~~~ http://a.b/''' http://a.b/###",
+        "markup <a href=\"https://example.com\">link</a>",
+        "mailto:a@b.c?subject=hi%20there&body=x",
+        "file://localhost/home/user/file.txt\nhttp://next.line\twww.tab.bed",
+        "hTtPs://MiXeD.CaSe/Path ftp:/missing.slash news:/x",
+        "w ww www wwww.example.com wwww..example.com",
+};
+
+/* non-ASCII input, only compared when a UTF-8 locale is available */
+static const char *corpus_utf8[] = {
+        "umlauts http://example.com/ümlaut/straße ok",
+        "after a letter éhttp://example.com and ·http://example.com",
+        "cjk http://例子.测试/路径 www.例子.测试。",
+        /* D-Bus only passes valid UTF-8, but don't choke on broken ends */
+        "http://a.b/x\xc3",
+        "http://a.b/\xff",
+};
+
+static const char *fragments[] = {
+        "http://", "https://", "ftp://", "ftps://", "news://", "mailto:",
+        "file://", "www.", "HTTP://", "Www.", "http:/", "ww",
+        "a", "Z", "0", "_", "-", ".", "!", "'", ",", "#", "(", ")", "@",
+        "\\", ";", "/", "?", ":", "&", "=", "%", "$", "+", "*", "~",
+        " ", "\n", "<", ">", "\"", "^", "example", "com",
+};
+
+static enum greatest_test_res compare(const char *input)
+{
+        char *urls = extract_urls(input);
+        char *expected = reference_extract_urls(input);
+
+        ASSERT_STR_EQm(input, expected ? expected : "(none)", urls ? urls : "(none)");
+
+        g_free(urls);
+        g_free(expected);
+        PASS();
+}
+
+TEST test_extract_urls(void)
+{
+        char *urls = extract_urls("see http://a.b/c and www.d.e.");
+        ASSERT_STR_EQ("http://a.b/c\nwww.d.e", urls);
+        g_free(urls);
+
+        ASSERT_EQ(NULL, extract_urls("nothing"));
+        PASS();
+}
+
+TEST test_extract_urls_corpus(void)
+{
+        for (int i = 0; i < G_N_ELEMENTS(corpus); i++)
+                CHECK_CALL(compare(corpus[i]));
+
+        GRand *rand = g_rand_new_with_seed(42);
+        for (int i = 0; i < 20000; i++) {
+                GString *input = g_string_new(NULL);
+                int n = g_rand_int_range(rand, 0, 16);
+                for (int j = 0; j < n; j++) {
+                        int k = g_rand_int_range(rand, 0, G_N_ELEMENTS(fragments));
+                        g_string_append(input, fragments[k]);
+                }
+
+                CHECK_CALL(compare(input->str));
+                g_string_free(input, true);
+        }
+        g_rand_free(rand);
+
+        PASS();
+}
+
+TEST test_extract_urls_utf8(void)
+{
+        char *locale = g_strdup(setlocale(LC_CTYPE, NULL));
+        if (!setlocale(LC_CTYPE, "C.UTF-8")) {
+                g_free(locale);
+                SKIPm("no UTF-8 locale");
+        }
+
+        /* the regex has to be compiled for the locale */
+        regfree(&reference_regex);
+        regcomp(&reference_regex, reference_pattern, REG_EXTENDED | REG_ICASE);
+
+        enum greatest_test_res res = GREATEST_TEST_RES_PASS;
+        for (int i = 0; i < G_N_ELEMENTS(corpus_utf8) && res == GREATEST_TEST_RES_PASS; i++)
+                res = compare(corpus_utf8[i]);
+
+        setlocale(LC_CTYPE, locale);
+        g_free(locale);
+
+        regfree(&reference_regex);
+        regcomp(&reference_regex, reference_pattern, REG_EXTENDED | REG_ICASE);
+
+        if (res != GREATEST_TEST_RES_PASS)
+                FAIL();
+        PASS();
+}
+
+SUITE(suite_menu)
+{
+        regcomp(&reference_regex, reference_pattern, REG_EXTENDED | REG_ICASE);
+
+        RUN_TEST(test_extract_urls);
+        RUN_TEST(test_extract_urls_corpus);
+        RUN_TEST(test_extract_urls_utf8);
+
+        regfree(&reference_regex);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
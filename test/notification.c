@@ -70,6 +70,48 @@ TEST test_notification_is_duplicate(void *notifications)
         PASS();
 }
 
+TEST test_notification_is_duplicate_raw_icon(void *notifications)
+{
+        notification **n = (notification**)notifications;
+        notification *a = n[0];
+        notification *b = n[1];
+        enum icon_position_t icon_setting_tmp = settings.icon_position;
+
+        unsigned char pixels_a[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+        unsigned char pixels_b[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+        RawImage raw_a = { 2, 1, 8, 1, 8, 4, pixels_a };
+        RawImage raw_b = { 2, 1, 8, 1, 8, 4, pixels_b };
+
+        b->urgency = a->urgency;
+        a->raw_icon = &raw_a;
+        b->raw_icon = &raw_b;
+
+        settings.icon_position = icons_left;
+        a->fingerprint = notification_fingerprint(a);
+        b->fingerprint = notification_fingerprint(b);
+        ASSERT_EQ(a->fingerprint, b->fingerprint);
+        ASSERT(notification_is_duplicate(a, b));
+
+        pixels_b[7] = 0;
+        b->fingerprint = notification_fingerprint(b);
+        ASSERT(a->fingerprint != b->fingerprint);
+        ASSERT_FALSE(notification_is_duplicate(a, b));
+
+        settings.icon_position = icons_off;
+        a->fingerprint = notification_fingerprint(a);
+        b->fingerprint = notification_fingerprint(b);
+        ASSERT_EQ(a->fingerprint, b->fingerprint);
+        ASSERT(notification_is_duplicate(a, b));
+
+        a->raw_icon = NULL;
+        b->raw_icon = NULL;
+        a->fingerprint = 0;
+        b->fingerprint = 0;
+        settings.icon_position = icon_setting_tmp;
+
+        PASS();
+}
+
 TEST test_notification_replace_single_field(void)
 {
         char *str = g_malloc(128 * sizeof(char));
@@ -97,6 +139,49 @@ TEST test_notification_replace_single_field(void)
         PASS();
 }
 
+TEST test_notification_urls(void)
+{
+        notification *n = notification_create();
+        n->appname = g_strdup("Test");
+        n->summary = g_strdup("Summary");
+        n->body = g_strdup("no url");
+
+        ASSERT_FALSE(notification_has_urls(n));
+        ASSERT_EQ(URLS_NONE, n->has_urls);
+        ASSERT_EQ(NULL, notification_urls(n));
+        ASSERT_FALSE(notification_has_urls(n));
+
+        /* nothing gets extracted before the urls are needed */
+        g_free(n->body);
+        n->body = g_strdup("see [link #1] and www.example.com");
+        n->link_urls = g_strdup("[#1] http://example.org");
+        n->urls_extracted = false;
+        n->has_urls = URLS_UNKNOWN;
+
+        ASSERT(notification_has_urls(n));
+        ASSERT_EQ(NULL, n->urls);
+        ASSERT_STR_EQ("[#1] http://example.org\nwww.example.com", notification_urls(n));
+        ASSERT(n->urls_extracted);
+
+        g_free(n->link_urls);
+        n->link_urls = NULL;
+        g_free(n->urls);
+        n->urls = NULL;
+        n->urls_extracted = false;
+        ASSERT(notification_has_urls(n));
+        ASSERT_EQ(URLS_SOME, n->has_urls);
+
+        n->actions = g_malloc0(sizeof(Actions));
+        n->actions->actions = g_strsplit("default,Open [it],other,Other", ",", -1);
+        n->actions->count = 4;
+
+        ASSERT_EQ(NULL, n->actions->dmenu_str);
+        ASSERT_STR_EQ("#Open (it) [Test]\n#Other [Test]", notification_dmenu_str(n));
+
+        notification_free(n);
+        PASS();
+}
+
 SUITE(suite_notification)
 {
         cmdline_load(0, NULL);
@@ -116,10 +201,12 @@ SUITE(suite_notification)
         notification *n[2] = {a, b};
 
         RUN_TEST1(test_notification_is_duplicate, (void*) n);
+        RUN_TEST1(test_notification_is_duplicate_raw_icon, (void*) n);
         g_free(a);
         g_free(b);
 
         RUN_TEST(test_notification_replace_single_field);
+        RUN_TEST(test_notification_urls);
 }
 
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
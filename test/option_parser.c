@@ -13,6 +13,8 @@ TEST test_next_section(void)
         ASSERT_STR_EQ("path", (section = next_section(section)));
         ASSERT_STR_EQ("int", (section = next_section(section)));
         ASSERT_STR_EQ("double", (section = next_section(section)));
+        ASSERT_EQ(NULL, next_section(section));
+        ASSERT_EQ(NULL, next_section("nonexistent"));
         PASS();
 }
 
@@ -57,6 +59,12 @@ TEST test_ini_get_string(void)
         ASSERT_STR_EQ("default value", (ptr = ini_get_string(string_section, "nonexistent", "default value")));
         free(ptr);
 
+        /* the first value of a key wins */
+        ASSERT_STR_EQ("first", (ptr = ini_get_string(string_section, "duplicate", "")));
+        free(ptr);
+        ASSERT_STR_EQ("default value", (ptr = ini_get_string("nonexistent", "simple", "default value")));
+        free(ptr);
+
         PASS();
 }
 
@@ -276,6 +284,42 @@ TEST test_option_get_bool(void)
         PASS();
 }
 
+TEST test_cmdline_usage_once(void)
+{
+        const char *usage = cmdline_create_usage();
+        const char *first = strstr(usage, "-msgint/-mi");
+        ASSERT(first);
+
+        /* asking for an option again doesn't describe it twice */
+        cmdline_get_int("-msgint/-mi", 0, "An int to test usage creation");
+        usage = cmdline_create_usage();
+        first = strstr(usage, "-msgint/-mi");
+        ASSERT(first);
+        ASSERT_FALSE(strstr(first + 1, "-msgint/-mi"));
+        PASS();
+}
+
+TEST test_cmdline_reload(void)
+{
+        char *argv[] = { "dunst", "-i", "5", "-int", "6", "-i", "7" };
+
+        /* the first occurrence wins and the long key precedes the short one */
+        cmdline_load(G_N_ELEMENTS(argv), argv);
+        ASSERT_EQ(6, cmdline_get_int("-int/-i", 0, ""));
+        ASSERT_EQ(5, cmdline_get_int("-i/-int", 0, ""));
+        ASSERT_EQ(5, cmdline_get_int("-unset/-i", 0, ""));
+        ASSERT_EQ(0, cmdline_get_int("-unset/-u", 0, ""));
+
+        /* resolved aliases don't survive loading another command line */
+        cmdline_load(3, argv);
+        ASSERT_EQ(5, cmdline_get_int("-int/-i", 0, ""));
+        ASSERT_FALSE(cmdline_is_set("-unset/-int"));
+
+        cmdline_load(0, NULL);
+        ASSERT_EQ(1, cmdline_get_int("-int/-i", 1, ""));
+        PASS();
+}
+
 SUITE(suite_option_parser)
 {
         FILE *config_file = fopen("data/test-ini", "r");
@@ -306,12 +350,14 @@ SUITE(suite_option_parser)
         RUN_TEST(test_cmdline_get_double);
         RUN_TEST(test_cmdline_get_bool);
         RUN_TEST(test_cmdline_create_usage);
+        RUN_TEST(test_cmdline_usage_once);
 
         RUN_TEST(test_option_get_string);
         RUN_TEST(test_option_get_path);
         RUN_TEST(test_option_get_int);
         RUN_TEST(test_option_get_double);
         RUN_TEST(test_option_get_bool);
+        RUN_TEST(test_cmdline_reload);
         free_ini();
         g_strfreev(argv);
         fclose(config_file);
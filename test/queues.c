@@ -0,0 +1,631 @@
+#include "greatest.h"
+#include "src/history_log.h"
+#include "src/queues.h"
+#include "src/settings.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+static notification *test_notification(const char *name, enum urgency urgency)
+{
+        notification *n = notification_create();
+        n->appname = g_strdup("queues");
+        n->summary = g_strdup(name);
+        n->body = g_strdup("");
+        n->icon = g_strdup("icon");
+        n->category = g_strdup("");
+        n->msg = g_strdup(name);
+        n->format = "%s";
+        n->markup = MARKUP_NO;
+        n->urgency = urgency;
+        n->progress = -1;
+        n->timeout = 10 * G_USEC_PER_SEC;
+
+        return n;
+}
+
+/*
+ * Check that every displayed notification can be found by its id
+ * and that the amount of indexed notifications matches the queues.
+ */
+TEST test_displayed_indexed(void)
+{
+        unsigned int count = 0;
+        for (const GList *iter = queues_get_displayed(); iter; iter = iter->next) {
+                notification *n = iter->data;
+                ASSERT_EQ(n, queues_get_by_id(n->id));
+                count++;
+        }
+        ASSERT_EQ(queues_length_displayed(), count);
+        PASS();
+}
+
+/*
+ * Check that the displayed notifications are in the same order
+ * as if they had been sorted with notification_cmp.
+ */
+TEST test_displayed_sorted(void)
+{
+        for (const GList *iter = queues_get_displayed(); iter && iter->next; iter = iter->next)
+                ASSERT(notification_cmp(iter->data, iter->next->data) < 0);
+        PASS();
+}
+
+TEST test_queue_insert(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_LOW);
+        notification *c = test_notification("c", URG_CRIT);
+
+        int id_a = queues_notification_insert(a, 0);
+        int id_b = queues_notification_insert(b, 0);
+        int id_c = queues_notification_insert(c, 0);
+
+        ASSERT(id_a != id_b && id_b != id_c && id_a != id_c);
+        ASSERT_EQ(3, queues_length_waiting());
+        ASSERT_EQ(a, queues_get_by_id(id_a));
+        ASSERT_EQ(b, queues_get_by_id(id_b));
+        ASSERT_EQ(c, queues_get_by_id(id_c));
+        ASSERT_EQ(NULL, queues_get_by_id(id_c + 1));
+
+        queues_update();
+        ASSERT_EQ(0, queues_length_waiting());
+        ASSERT_EQ(3, queues_length_displayed());
+        CHECK_CALL(test_displayed_indexed());
+
+        /* sorted by urgency */
+        const GList *iter = queues_get_displayed();
+        ASSERT_EQ(c, iter->data);
+        ASSERT_EQ(a, iter->next->data);
+        ASSERT_EQ(b, iter->next->next->data);
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_stack(void)
+{
+        queues_init();
+
+        notification *a = test_notification("dup", URG_NORM);
+        notification *b = test_notification("dup", URG_NORM);
+        notification *c = test_notification("dup", URG_NORM);
+
+        int id_a = queues_notification_insert(a, 0);
+        int id_b = queues_notification_insert(b, 0);
+
+        ASSERT_EQ(1, queues_length_waiting());
+        ASSERT_EQ(NULL, queues_get_by_id(id_a));
+        ASSERT_EQ(b, queues_get_by_id(id_b));
+        ASSERT_EQ(1, b->dup_count);
+
+        queues_update();
+        int id_c = queues_notification_insert(c, 0);
+
+        ASSERT_EQ(0, queues_length_waiting());
+        ASSERT_EQ(1, queues_length_displayed());
+        ASSERT_EQ(NULL, queues_get_by_id(id_b));
+        ASSERT_EQ(c, queues_get_by_id(id_c));
+        ASSERT_EQ(2, c->dup_count);
+        CHECK_CALL(test_displayed_indexed());
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_replace(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_NORM);
+        notification *c = test_notification("c", URG_NORM);
+        notification *d = test_notification("d", URG_NORM);
+
+        int id_a = queues_notification_insert(a, 0);
+        int id_b = queues_notification_insert(b, 0);
+
+        /* replace while waiting */
+        ASSERT_EQ(id_a, queues_notification_insert(c, id_a));
+        ASSERT_EQ(2, queues_length_waiting());
+        ASSERT_EQ(c, queues_get_by_id(id_a));
+        ASSERT_EQ(b, queues_get_by_id(id_b));
+
+        /* replace while displayed */
+        queues_update();
+        ASSERT_EQ(id_b, queues_notification_insert(d, id_b));
+        ASSERT_EQ(2, queues_length_displayed());
+        ASSERT_EQ(d, queues_get_by_id(id_b));
+        ASSERT(d->start > 0);
+        CHECK_CALL(test_displayed_indexed());
+
+        /* replace a nonexistent id */
+        notification *e = test_notification("e", URG_NORM);
+        ASSERT_EQ(4242, queues_notification_insert(e, 4242));
+        ASSERT_EQ(e, queues_get_by_id(4242));
+        ASSERT_EQ(1, queues_length_waiting());
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_close(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_NORM);
+        notification *c = test_notification("c", URG_NORM);
+
+        int id_a = queues_notification_insert(a, 0);
+        int id_b = queues_notification_insert(b, 0);
+        queues_update();
+        int id_c = queues_notification_insert(c, 0);
+
+        /* close displayed */
+        queues_notification_close_id(id_a, REASON_USER);
+        ASSERT_EQ(NULL, queues_get_by_id(id_a));
+        ASSERT_EQ(1, queues_length_displayed());
+        ASSERT_EQ(1, queues_length_history());
+        CHECK_CALL(test_displayed_indexed());
+
+        /* close waiting */
+        queues_notification_close(c, REASON_SIG);
+        ASSERT_EQ(NULL, queues_get_by_id(id_c));
+        ASSERT_EQ(0, queues_length_waiting());
+        ASSERT_EQ(2, queues_length_history());
+
+        /* closing an unknown id is a no-op */
+        queues_notification_close_id(id_c, REASON_SIG);
+        ASSERT_EQ(2, queues_length_history());
+        ASSERT_EQ(b, queues_get_by_id(id_b));
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_history(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_NORM);
+
+        int id_a = queues_notification_insert(a, 0);
+        queues_update();
+        queues_history_push_all();
+
+        ASSERT_EQ(0, queues_length_displayed());
+        ASSERT_EQ(1, queues_length_history());
+        ASSERT_EQ(NULL, queues_get_by_id(id_a));
+
+        queues_history_pop();
+        ASSERT_EQ(0, queues_length_history());
+        ASSERT_EQ(1, queues_length_waiting());
+        ASSERT_EQ(a, queues_get_by_id(id_a));
+        ASSERT(a->redisplayed);
+
+        /* the id of a is taken over while it resides in history */
+        queues_notification_close_id(id_a, REASON_USER);
+        ASSERT_EQ(id_a, queues_notification_insert(b, id_a));
+        queues_history_pop();
+
+        ASSERT_EQ(2, queues_length_waiting());
+        ASSERT_EQ(b, queues_get_by_id(id_a));
+        ASSERT(a->id != id_a);
+        ASSERT_EQ(a, queues_get_by_id(a->id));
+
+        queues_update();
+        CHECK_CALL(test_displayed_indexed());
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_history_ring(void)
+{
+        queues_init();
+        settings.history_length = 3;
+
+        int ids[5];
+        for (int i = 0; i < 5; i++) {
+                char name[] = { 'a' + i, '\0' };
+                ids[i] = queues_notification_insert(test_notification(name, URG_NORM), 0);
+        }
+        queues_update();
+        queues_history_push_all();
+
+        /* only the last three are kept */
+        ASSERT_EQ(3, queues_length_history());
+
+        queues_history_pop();
+        queues_history_pop();
+        queues_history_pop();
+        queues_history_pop();
+        ASSERT_EQ(0, queues_length_history());
+        ASSERT_EQ(3, queues_length_waiting());
+        ASSERT_EQ(NULL, queues_get_by_id(ids[0]));
+        ASSERT_EQ(NULL, queues_get_by_id(ids[1]));
+
+        /* popped notifications are displayable again */
+        notification *c = queues_get_by_id(ids[2]);
+        ASSERT(c);
+        ASSERT_STR_EQ("c", c->msg);
+
+        teardown_queues();
+        settings.history_length = 20;
+        PASS();
+}
+
+TEST test_queue_history_memory(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_NORM);
+        notification *c = test_notification("c", URG_NORM);
+        c->raw_icon = g_malloc(sizeof(RawImage));
+        *c->raw_icon = (RawImage) { 64, 64, 64 * 3, false, 8, 3, g_malloc0(64 * 64 * 3) };
+        settings.history_raw_icon = HISTORY_RAW_ICON_KEEP;
+        settings.icon_position = icons_left;
+
+        queues_history_push(a);
+        queues_history_push(b);
+        gsize size = queues_history_size();
+        ASSERT(size > 0);
+        ASSERT(size < 64 * 64 * 3);
+
+        /* the large raw icon pushes out the oldest notification */
+        settings.history_memory = 64 * 64 * 3 + size;
+        queues_history_push(c);
+        ASSERT(queues_length_history() < 3);
+        ASSERT(queues_history_size() > 64 * 64 * 3);
+        ASSERT(queues_history_size() <= settings.history_memory);
+
+        queues_history_pop();
+        ASSERT_EQ(c, queues_get_by_id(c->id));
+        while (queues_length_history() > 0)
+                queues_history_pop();
+        ASSERT_EQ(0, queues_history_size());
+
+        teardown_queues();
+        settings.history_memory = 0;
+        settings.history_raw_icon = HISTORY_RAW_ICON_SCALE;
+        settings.icon_position = icons_off;
+        PASS();
+}
+
+TEST test_queue_history_log(void)
+{
+        char *dir = g_build_filename(g_get_tmp_dir(), "dunst-test-XXXXXX", NULL);
+        ASSERT(g_mkdtemp(dir));
+        char *path = g_build_filename(dir, "history", NULL);
+
+        queues_init();
+        ASSERT(history_log_open(path, 0));
+
+        /* a doesn't fit into history, so it mustn't end up in the log */
+        settings.history_memory = 1;
+        queues_history_push(test_notification("a", URG_NORM));
+        ASSERT_EQ(0, queues_length_history());
+
+        settings.history_memory = 0;
+        queues_history_push(test_notification("b", URG_NORM));
+        queues_history_pop();
+        ASSERT_EQ(0, queues_length_history());
+        history_log_close();
+
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(0, history_log_length());
+        for (int i = 0; i < 3; i++)
+                queues_history_push(test_notification("c", URG_NORM));
+        history_log_close();
+        teardown_queues();
+
+        /* the replayed notifications have to fit into history_memory, too */
+        queues_init();
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(3, queues_length_history());
+        ASSERT(queues_history_size() > 0);
+        settings.history_memory = queues_history_size() - 1;
+        queues_history_trim();
+        ASSERT_EQ(2, queues_length_history());
+        ASSERT(queues_history_size() <= settings.history_memory);
+        history_log_close();
+
+        settings.history_memory = 0;
+        ASSERT(history_log_open(path, 0));
+        ASSERT_EQ(2, history_log_length());
+        history_log_close();
+
+        teardown_queues();
+        g_unlink(path);
+        g_rmdir(dir);
+        g_free(path);
+        g_free(dir);
+        PASS();
+}
+
+TEST test_queue_history_raw_icon(void)
+{
+        queues_init();
+        settings.icon_position = icons_left;
+        settings.max_icon_size = 1;
+
+        notification *n = test_notification("a", URG_NORM);
+        n->raw_icon = g_malloc(sizeof(RawImage));
+        *n->raw_icon = (RawImage) { 2, 1, 6, false, 8, 3, g_malloc0(6) };
+
+        int id = queues_notification_insert(n, 0);
+        queues_notification_close_id(id, REASON_USER);
+        queues_history_pop();
+
+        ASSERT_EQ(n, queues_get_by_id(id));
+        ASSERT(n->raw_icon);
+        ASSERT_EQ(1, n->raw_icon->width);
+
+        /* without a max_icon_size there is nothing to scale to */
+        rawimage_free(n->raw_icon);
+        n->raw_icon = g_malloc(sizeof(RawImage));
+        *n->raw_icon = (RawImage) { 2, 1, 6, false, 8, 3, g_malloc0(6) };
+        settings.max_icon_size = 0;
+        queues_notification_close_id(id, REASON_USER);
+        queues_history_pop();
+        ASSERT_EQ(2, n->raw_icon->width);
+
+        queues_notification_close_id(id, REASON_USER);
+        settings.history_raw_icon = HISTORY_RAW_ICON_DROP;
+        queues_history_pop();
+        queues_history_push_all();
+        queues_history_pop();
+
+        ASSERT_EQ(NULL, n->raw_icon);
+        ASSERT(n->icon);
+
+        teardown_queues();
+        settings.history_raw_icon = HISTORY_RAW_ICON_SCALE;
+        settings.max_icon_size = 0;
+        settings.icon_position = icons_off;
+        PASS();
+}
+
+TEST test_queue_pause(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_CRIT);
+
+        int id_a = queues_notification_insert(a, 0);
+        queues_update();
+
+        queues_pause_on();
+        queues_update();
+        int id_b = queues_notification_insert(b, 0);
+
+        ASSERT_EQ(0, queues_length_displayed());
+        ASSERT_EQ(2, queues_length_waiting());
+        ASSERT_EQ(a, queues_get_by_id(id_a));
+        ASSERT_EQ(b, queues_get_by_id(id_b));
+
+        queues_pause_off();
+        queues_update();
+        ASSERT_EQ(2, queues_length_displayed());
+        ASSERT_EQ(b, queues_get_displayed()->data);
+        CHECK_CALL(test_displayed_indexed());
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_timeout(void)
+{
+        queues_init();
+
+        notification *a = test_notification("a", URG_NORM);
+        notification *b = test_notification("b", URG_NORM);
+        notification *c = test_notification("c", URG_NORM);
+        notification *d = test_notification("d", URG_NORM);
+
+        a->timeout = 1;
+        b->timeout = 2;
+        c->timeout = 0;
+        d->transient = true;
+        d->timeout = 1;
+
+        int id_a = queues_notification_insert(a, 0);
+        int id_b = queues_notification_insert(b, 0);
+        int id_c = queues_notification_insert(c, 0);
+        int id_d = queues_notification_insert(d, 0);
+        queues_update();
+
+        gint64 next = queues_get_next_datachange(g_get_monotonic_time());
+        ASSERT(next >= 0 && next <= 1);
+
+        /* only transient notifications time out while idle */
+        gint64 start = a->start;
+        g_usleep(1000);
+        queues_check_timeouts(true);
+        ASSERT_EQ(3, queues_length_displayed());
+        ASSERT_EQ(NULL, queues_get_by_id(id_d));
+        ASSERT(a->start > start);
+        CHECK_CALL(test_displayed_indexed());
+
+        g_usleep(1000);
+        queues_check_timeouts(false);
+        ASSERT_EQ(1, queues_length_displayed());
+        ASSERT_EQ(NULL, queues_get_by_id(id_a));
+        ASSERT_EQ(NULL, queues_get_by_id(id_b));
+        ASSERT_EQ(c, queues_get_by_id(id_c));
+
+        /* sticky notifications don't need a wakeup */
+        ASSERT_EQ(-1, queues_get_next_datachange(g_get_monotonic_time()));
+
+        teardown_queues();
+        PASS();
+}
+
+TEST test_queue_sorted(void)
+{
+        enum urgency urgencies[] = { URG_NORM, URG_LOW, URG_CRIT, URG_LOW, URG_CRIT, URG_NORM };
+        int ids[6];
+
+        queues_init();
+        queues_displayed_limit(3);
+
+        for (int i = 0; i < 6; i++) {
+                char name[] = { 'a' + i, '\0' };
+                ids[i] = queues_notification_insert(test_notification(name, urgencies[i]), 0);
+        }
+
+        /* an explicit id sorts behind all automatic ones */
+        queues_notification_insert(test_notification("high", URG_LOW), 4242);
+
+        queues_update();
+        ASSERT_EQ(3, queues_length_displayed());
+        ASSERT_EQ(4, queues_length_waiting());
+        CHECK_CALL(test_displayed_sorted());
+
+        /* reuse a low id, so it interleaves with the displayed ones */
+        queues_notification_close_id(ids[2], REASON_USER);
+        ASSERT_EQ(ids[2], queues_notification_insert(test_notification("low", URG_CRIT), ids[2]));
+
+        /* changing the urgency on replace moves the notification */
+        queues_notification_insert(test_notification("up", URG_CRIT), ids[1]);
+
+        queues_pause_on();
+        queues_update();
+        ASSERT_EQ(0, queues_length_displayed());
+        ASSERT_EQ(7, queues_length_waiting());
+
+        queues_pause_off();
+        queues_displayed_limit(0);
+        queues_update();
+        ASSERT_EQ(7, queues_length_displayed());
+        CHECK_CALL(test_displayed_sorted());
+        CHECK_CALL(test_displayed_indexed());
+
+        /* closing shrinks the urgency runs */
+        queues_notification_close_id(ids[0], REASON_USER);
+        queues_notification_close_id(ids[4], REASON_USER);
+        queues_notification_insert(test_notification("crit", URG_CRIT), 0);
+        queues_update();
+        ASSERT_EQ(6, queues_length_displayed());
+        CHECK_CALL(test_displayed_sorted());
+
+        teardown_queues();
+        queues_displayed_limit(0);
+        PASS();
+}
+
+TEST test_queue_resort(void)
+{
+        enum urgency urgencies[] = { URG_NORM, URG_LOW, URG_CRIT, URG_LOW, URG_CRIT, URG_NORM };
+
+        settings.sort = false;
+        queues_init();
+
+        for (int i = 0; i < 6; i++) {
+                char name[] = { 'a' + i, '\0' };
+                queues_notification_insert(test_notification(name, urgencies[i]), 0);
+        }
+        queues_update();
+
+        settings.sort = true;
+        queues_resort();
+        CHECK_CALL(test_displayed_sorted());
+        CHECK_CALL(test_displayed_indexed());
+
+        /* the urgency runs are usable for inserting again */
+        queues_notification_insert(test_notification("g", URG_NORM), 0);
+        queues_update();
+        ASSERT_EQ(7, queues_length_displayed());
+        CHECK_CALL(test_displayed_sorted());
+
+        /* without sorting, the newest notification comes first */
+        settings.sort = false;
+        queues_resort();
+        for (const GList *iter = queues_get_displayed(); iter && iter->next; iter = iter->next)
+                ASSERT(((notification *) iter->data)->id > ((notification *) iter->next->data)->id);
+        CHECK_CALL(test_displayed_indexed());
+
+        teardown_queues();
+        settings.sort = true;
+        PASS();
+}
+
+TEST test_queue_update_fingerprints(void)
+{
+        settings.icon_position = icons_left;
+        queues_init();
+
+        notification *a = test_notification("dup", URG_NORM);
+        notification *b = test_notification("dup", URG_NORM);
+        g_free(b->icon);
+        b->icon = g_strdup("other");
+        a->fingerprint = notification_fingerprint(a);
+        b->fingerprint = notification_fingerprint(b);
+        ASSERT(a->fingerprint != b->fingerprint);
+
+        queues_notification_insert(a, 0);
+        queues_notification_insert(b, 0);
+        ASSERT_EQ(2, queues_length_waiting());
+
+        /* without icons, both are duplicates of the next one */
+        settings.icon_position = icons_off;
+        queues_update_fingerprints();
+
+        notification *c = test_notification("dup", URG_NORM);
+        c->fingerprint = notification_fingerprint(c);
+        queues_notification_insert(c, 0);
+        ASSERT_EQ(2, queues_length_waiting());
+        ASSERT_EQ(1, c->dup_count);
+
+        /* notifications recalled from history get a fresh fingerprint */
+        queues_history_push_all();
+        settings.icon_position = icons_left;
+        queues_history_pop();
+        queues_history_pop();
+        ASSERT_EQ(2, queues_length_waiting());
+
+        notification *d = test_notification("dup", URG_NORM);
+        d->fingerprint = notification_fingerprint(d);
+        queues_notification_insert(d, 0);
+        ASSERT_EQ(2, queues_length_waiting());
+        ASSERT(d->dup_count > 0);
+
+        teardown_queues();
+        settings.icon_position = icons_off;
+        PASS();
+}
+
+SUITE(suite_queues)
+{
+        settings.stack_duplicates = true;
+        settings.sort = true;
+        settings.history_length = 20;
+        settings.history_raw_icon = HISTORY_RAW_ICON_SCALE;
+        settings.print_notifications = false;
+        settings.icon_position = icons_off;
+        settings.show_age_threshold = -1;
+        queues_displayed_limit(0);
+
+        RUN_TEST(test_queue_insert);
+        RUN_TEST(test_queue_stack);
+        RUN_TEST(test_queue_replace);
+        RUN_TEST(test_queue_close);
+        RUN_TEST(test_queue_history);
+        RUN_TEST(test_queue_history_ring);
+        RUN_TEST(test_queue_history_raw_icon);
+        RUN_TEST(test_queue_history_memory);
+        RUN_TEST(test_queue_history_log);
+        RUN_TEST(test_queue_pause);
+        RUN_TEST(test_queue_timeout);
+        RUN_TEST(test_queue_sorted);
+        RUN_TEST(test_queue_resort);
+        RUN_TEST(test_queue_update_fingerprints);
+}
+
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,276 @@
+#include "greatest.h"
+#include "src/rawimage.h"
+
+#include <glib.h>
+#include <string.h>
+
+TEST test_rawimage_scale_down(void)
+{
+        /* two opaque gray pixels, an opaque red and a transparent green one */
+        unsigned char pixels[] = { 0, 0, 0, 255,    100, 100, 100, 255,
+                                   200, 0, 0, 255,  0, 255, 0, 0 };
+        RawImage i = { 4, 1, 16, 1, 8, 4, pixels };
+
+        RawImage *s = rawimage_scale_down(&i, 2);
+        ASSERT(s);
+        ASSERT_EQ(2, s->width);
+        ASSERT_EQ(1, s->height);
+        ASSERT_EQ(8, s->rowstride);
+        ASSERT_EQ(8, rawimage_data_size(s));
+
+        unsigned char expected[] = { 50, 50, 50, 255,   200, 0, 0, 127 };
+        ASSERT_MEM_EQ(expected, s->data, sizeof(expected));
+        rawimage_free(s);
+
+        PASS();
+}
+
+TEST test_rawimage_scale_down_noop(void)
+{
+        unsigned char pixels[12] = { 0 };
+        RawImage i = { 2, 2, 6, 0, 8, 3, pixels };
+
+        ASSERT_EQ(NULL, rawimage_scale_down(&i, 2));
+        ASSERT_EQ(NULL, rawimage_scale_down(&i, 0));
+
+        i.bits_per_sample = 16;
+        ASSERT_EQ(NULL, rawimage_scale_down(&i, 1));
+
+        i.bits_per_sample = 8;
+        RawImage *s = rawimage_scale_down(&i, 1);
+        ASSERT(s);
+        ASSERT_EQ(1, s->width);
+        ASSERT_EQ(1, s->height);
+        rawimage_free(s);
+
+        PASS();
+}
+
+static guint32 premultiplied(const unsigned char *p, bool alpha)
+{
+        guint32 a = alpha ? p[3] : 255;
+        return a << 24 | (p[0] * a + 127) / 255 << 16
+               | (p[1] * a + 127) / 255 << 8 | (p[2] * a + 127) / 255;
+}
+
+TEST test_rawimage_to_argb32(void)
+{
+        unsigned char pixels[2 * 9 * 4];
+        guint32 argb[2 * 9];
+
+        GRand *rand = g_rand_new_with_seed(42);
+        for (int i = 0; i < sizeof(pixels); i++)
+                pixels[i] = g_rand_int_range(rand, 0, 256);
+        g_rand_free(rand);
+        pixels[3] = 0;
+        pixels[7] = 255;
+
+        /* every row length, to cover the vectorized loop and its tail */
+        for (int width = 1; width <= 9; width++) {
+                RawImage i = { width, 2, 9 * 4, 1, 8, 4, pixels };
+                memset(argb, 0, sizeof(argb));
+
+                ASSERT(rawimage_to_argb32(&i, width, 2, argb, 9 * 4));
+                for (int y = 0; y < 2; y++)
+                        for (int x = 0; x < width; x++)
+                                ASSERT_EQ_FMT(premultiplied(pixels + y * 9 * 4 + x * 4, true),
+                                              argb[y * 9 + x], "%08x");
+        }
+
+        RawImage rgb = { 3, 2, 9 * 4, 0, 8, 3, pixels };
+        ASSERT(rawimage_to_argb32(&rgb, 3, 2, argb, 3 * 4));
+        for (int y = 0; y < 2; y++)
+                for (int x = 0; x < 3; x++)
+                        ASSERT_EQ_FMT(premultiplied(pixels + y * 9 * 4 + x * 3, false),
+                                      argb[y * 3 + x], "%08x");
+
+        PASS();
+}
+
+TEST test_rawimage_to_argb32_scaled(void)
+{
+        /* two opaque gray pixels, an opaque red and a transparent green one */
+        unsigned char pixels[] = { 0, 0, 0, 255,    100, 100, 100, 255,
+                                   200, 0, 0, 255,  0, 255, 0, 0 };
+        RawImage i = { 4, 1, 16, 1, 8, 4, pixels };
+        guint32 argb[2];
+
+        int width, height;
+        rawimage_scaled_size(&i, 2, &width, &height);
+        ASSERT_EQ(2, width);
+        ASSERT_EQ(1, height);
+
+        ASSERT(rawimage_to_argb32(&i, width, height, argb, sizeof(argb)));
+        ASSERT_EQ_FMT(0xff323232, argb[0], "%08x");
+        ASSERT_EQ_FMT(0x80640000, argb[1], "%08x");
+
+        PASS();
+}
+
+TEST test_rawimage_to_argb32_invalid(void)
+{
+        unsigned char pixels[16] = { 0 };
+        guint32 argb[4];
+        RawImage i = { 2, 2, 8, 1, 8, 4, pixels };
+
+        ASSERT(rawimage_to_argb32(&i, 2, 2, argb, 8));
+        ASSERT_FALSE(rawimage_to_argb32(&i, 3, 2, argb, 12));
+
+        i.rowstride = 7;
+        ASSERT_FALSE(rawimage_to_argb32(&i, 2, 2, argb, 8));
+        i.rowstride = 8;
+        i.bits_per_sample = 16;
+        ASSERT_FALSE(rawimage_to_argb32(&i, 1, 1, argb, 4));
+        i.bits_per_sample = 8;
+        i.n_channels = 2;
+        ASSERT_FALSE(rawimage_to_argb32(&i, 1, 1, argb, 4));
+
+        PASS();
+}
+
+static RawImage *gray_image(unsigned char value)
+{
+        RawImage *i = g_malloc(sizeof(RawImage));
+        *i = (RawImage) { 2, 2, 6, 0, 8, 3, g_malloc(12) };
+        memset(i->data, value, 12);
+        return i;
+}
+
+TEST test_rawimage_intern(void)
+{
+        RawImage *a = rawimage_intern(gray_image(10));
+        RawImage *b = rawimage_intern(gray_image(10));
+        RawImage *c = rawimage_intern(gray_image(20));
+
+        ASSERT_EQ(a, b);
+        ASSERT(a != c);
+        ASSERT(a->id != c->id);
+        ASSERT_EQ(2, a->refcount);
+
+        /* interning again doesn't take another reference */
+        ASSERT_EQ(a, rawimage_intern(a));
+        ASSERT_EQ(2, a->refcount);
+
+        /* the image is shared until the last reference is gone */
+        rawimage_free(b);
+        ASSERT_EQ(1, a->refcount);
+        ASSERT_EQ(10, a->data[11]);
+
+        guint64 id = a->id;
+        rawimage_free(a);
+        a = rawimage_intern(gray_image(10));
+        ASSERT(a->id != id);
+        ASSERT_EQ(1, a->refcount);
+
+        /* copies are independent of the interned image */
+        RawImage *s = rawimage_scale_down(a, 1);
+        ASSERT_EQ(0, s->id);
+        ASSERT_EQ(0, s->refcount);
+        rawimage_free(s);
+
+        rawimage_free(a);
+        rawimage_free(c);
+        PASS();
+}
+
+TEST test_rawimage_equal(void)
+{
+        RawImage *a = gray_image(10);
+        RawImage *b = gray_image(10);
+
+        ASSERT(rawimage_equal(a, a));
+        ASSERT(rawimage_equal(a, b));
+        ASSERT(rawimage_equal(NULL, NULL));
+        ASSERT_FALSE(rawimage_equal(a, NULL));
+
+        b->data[5] = 11;
+        ASSERT_FALSE(rawimage_equal(a, b));
+        b->data[5] = 10;
+        b->has_alpha = 1;
+        ASSERT_FALSE(rawimage_equal(a, b));
+
+        rawimage_free(a);
+        rawimage_free(b);
+        PASS();
+}
+
+static int released = 0;
+
+static void count_release(gpointer data)
+{
+        released++;
+}
+
+TEST test_rawimage_variant(void)
+{
+        unsigned char pixels[12];
+        memset(pixels, 10, sizeof(pixels));
+        released = 0;
+
+        GVariant *data = g_variant_new_from_data(G_VARIANT_TYPE("ay"), pixels, sizeof(pixels),
+                                                 TRUE, count_release, NULL);
+        RawImage *i = g_malloc(sizeof(RawImage));
+        *i = (RawImage) { 2, 2, 6, 0, 8, 3, (unsigned char *) g_variant_get_data(data),
+                          g_variant_ref_sink(data) };
+
+        /* the pixels are shared with the variant, not copied */
+        i = rawimage_intern(i);
+        ASSERT_EQ(pixels, i->data);
+
+        RawImage *copy = rawimage_intern(gray_image(10));
+        ASSERT_EQ(i, copy);
+        rawimage_free(copy);
+        ASSERT_EQ(0, released);
+
+        RawImage *s = rawimage_scale_down(i, 1);
+        ASSERT_EQ(NULL, s->variant);
+        rawimage_free(i);
+        ASSERT_EQ(1, released);
+
+        ASSERT_EQ(10, s->data[0]);
+        rawimage_free(s);
+        PASS();
+}
+
+TEST test_rawimage_detach(void)
+{
+        unsigned char pixels[12];
+        memset(pixels, 10, sizeof(pixels));
+        released = 0;
+
+        GVariant *data = g_variant_new_from_data(G_VARIANT_TYPE("ay"), pixels, sizeof(pixels),
+                                                 TRUE, count_release, NULL);
+        RawImage *i = g_malloc(sizeof(RawImage));
+        *i = (RawImage) { 2, 2, 6, 0, 8, 3, (unsigned char *) g_variant_get_data(data),
+                          g_variant_ref_sink(data) };
+        i = rawimage_intern(i);
+
+        /* the interned image keeps its content, but not the variant */
+        rawimage_detach(i);
+        ASSERT_EQ(1, released);
+        ASSERT_EQ(NULL, i->variant);
+        ASSERT(i->data != pixels);
+        ASSERT_MEM_EQ(pixels, i->data, sizeof(pixels));
+
+        RawImage *copy = rawimage_intern(gray_image(10));
+        ASSERT_EQ(i, copy);
+        rawimage_free(copy);
+
+        rawimage_detach(i);
+        rawimage_free(i);
+        PASS();
+}
+
+SUITE(suite_rawimage)
+{
+        RUN_TEST(test_rawimage_scale_down);
+        RUN_TEST(test_rawimage_scale_down_noop);
+        RUN_TEST(test_rawimage_to_argb32);
+        RUN_TEST(test_rawimage_to_argb32_scaled);
+        RUN_TEST(test_rawimage_to_argb32_invalid);
+        RUN_TEST(test_rawimage_intern);
+        RUN_TEST(test_rawimage_equal);
+        RUN_TEST(test_rawimage_variant);
+        RUN_TEST(test_rawimage_detach);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
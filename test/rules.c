@@ -0,0 +1,280 @@
+#include "greatest.h"
+#include "src/dunst.h"
+#include "src/rules.h"
+
+#include <glib.h>
+#include <stdbool.h>
+
+static const char *appnames[] = { "firefox", "Firefox", "fire", "mail", "", "a*b", "x?y" };
+static const char *categories[] = { "", "email", "email.arrived", "im", "device" };
+static const char *texts[] = { "", "hello", "Hello world", "world", "hello world!", "*", "[x]", "a\\b" };
+static const char *icons[] = { "", "dialog-information", "/usr/share/icons/a.png", "icon" };
+static char *colors[] = { "#000000", "#ffffff", "#ff0000" };
+
+static const char *patterns[] = {
+        NULL, NULL, NULL,
+        "firefox", "Firefox", "fire*", "*fox", "*ref*", "*", "**", "f*x",
+        "mail", "email", "email.*", "*.arrived", "*mail*", "im", "",
+        "hello", "hello*", "*world", "*o w*", "?ello*", "[Hh]ello*", "*!",
+        "\\*", "[x]", "a\\\\b", "a\\b", "*b", "x?y", "dialog-*", "*.png",
+};
+
+static const char *regexes[] = {
+        "fire(fox)?", "^F", "[Ff]ire", "o w", "hel+o", "wor?ld", "x\\?y", "a\\\\b",
+        "(", "e(mail|x)", "im|device", "\\.arrived$", "ello\\b", "\\w+ \\w+",
+        "icon$", "l{2}o", "^$", ".*", "orld!?$", "HELLO", "dialog-(info|warn)",
+        "[[:alpha:]]+\\.png", "x{y|z}w", "(?i)fox", "[^a-z]ello",
+};
+
+static GRand *rng = NULL;
+
+static const char *pick(const char **array, int len)
+{
+        return array[g_rand_int_range(rng, 0, len)];
+}
+
+static char *random_filter(enum match_mode *mode)
+{
+        switch (g_rand_int_range(rng, 0, 8)) {
+        case 0:
+                *mode = MATCH_GLOB_CASELESS;
+                return g_strdup(pick(patterns, G_N_ELEMENTS(patterns)));
+        case 1:
+                *mode = MATCH_REGEX;
+                return g_strdup(pick(regexes, G_N_ELEMENTS(regexes)));
+        case 2:
+                *mode = MATCH_REGEX_CASELESS;
+                return g_strdup(pick(regexes, G_N_ELEMENTS(regexes)));
+        default:
+                *mode = MATCH_GLOB;
+                return g_strdup(pick(patterns, G_N_ELEMENTS(patterns)));
+        }
+}
+
+static rule_t *random_rule(void)
+{
+        rule_t *r = g_malloc(sizeof(rule_t));
+        rule_init(r);
+
+        /* mostly literal appnames and categories to exercise the index */
+        if (g_rand_boolean(rng))
+                r->appname = g_strdup(pick(appnames, G_N_ELEMENTS(appnames)));
+        else
+                r->appname = random_filter(&r->appname_match);
+        if (g_rand_boolean(rng))
+                r->category = g_strdup(pick(categories, G_N_ELEMENTS(categories)));
+        else
+                r->category = random_filter(&r->category_match);
+        r->summary = random_filter(&r->summary_match);
+        r->body = random_filter(&r->body_match);
+        r->icon = random_filter(&r->icon_match);
+
+        r->msg_urgency = g_rand_int_range(rng, URG_NONE, URG_MAX + 1);
+        r->match_transient = g_rand_int_range(rng, -1, 2);
+
+        /* actions, which change fields matched by later rules */
+        r->urgency = g_rand_int_range(rng, URG_NONE, URG_MAX + 1);
+        r->set_transient = g_rand_int_range(rng, -1, 2);
+        if (g_rand_int_range(rng, 0, 4) == 0)
+                r->new_icon = g_strdup(pick(icons, G_N_ELEMENTS(icons)));
+        r->timeout = g_rand_int_range(rng, 0, 1000);
+        if (g_rand_int_range(rng, 0, 4) == 0)
+                r->fg = colors[g_rand_int_range(rng, 0, G_N_ELEMENTS(colors))];
+
+        /* leave content filters out sometimes, to make outcomes cacheable */
+        if (g_rand_boolean(rng)) {
+                g_free(r->summary);
+                g_free(r->body);
+                g_free(r->icon);
+                r->summary = r->body = r->icon = NULL;
+        }
+
+        return r;
+}
+
+static void rule_free(gpointer data)
+{
+        rule_t *r = data;
+
+        g_free(r->appname);
+        g_free(r->summary);
+        g_free(r->body);
+        g_free(r->icon);
+        g_free(r->category);
+        g_free(r->new_icon);
+        g_free(r);
+}
+
+static notification *random_notification(void)
+{
+        notification *n = notification_create();
+
+        n->appname = g_strdup(pick(appnames, G_N_ELEMENTS(appnames)));
+        n->category = g_strdup(pick(categories, G_N_ELEMENTS(categories)));
+        n->summary = g_strdup(pick(texts, G_N_ELEMENTS(texts)));
+        n->body = g_strdup(pick(texts, G_N_ELEMENTS(texts)));
+        n->icon = g_strdup(pick(icons, G_N_ELEMENTS(icons)));
+        n->urgency = g_rand_int_range(rng, URG_MIN, URG_MAX + 1);
+        n->transient = g_rand_boolean(rng);
+        n->timeout = -1;
+
+        return n;
+}
+
+static notification *notification_copy(const notification *n)
+{
+        notification *copy = notification_create();
+
+        copy->appname = g_strdup(n->appname);
+        copy->category = g_strdup(n->category);
+        copy->summary = g_strdup(n->summary);
+        copy->body = g_strdup(n->body);
+        copy->icon = g_strdup(n->icon);
+        copy->urgency = n->urgency;
+        copy->transient = n->transient;
+        copy->timeout = n->timeout;
+
+        return copy;
+}
+
+TEST test_rule_apply_all_differential(void)
+{
+        guint64 hits, misses, hits_before, misses_before;
+        rules_cache_stats(&hits_before, &misses_before);
+
+        rng = g_rand_new_with_seed(1337);
+
+        for (int round = 0; round < 50; round++) {
+                GSList *saved = rules;
+                rules = NULL;
+                int count = g_rand_int_range(rng, 1, 300);
+                for (int i = 0; i < count; i++)
+                        rules = g_slist_append(rules, random_rule());
+                rules_compile();
+
+                for (int i = 0; i < 200; i++) {
+                        notification *expected = random_notification();
+                        notification *n = notification_copy(expected);
+
+                        for (GSList *iter = rules; iter; iter = iter->next) {
+                                rule_t *r = iter->data;
+                                if (rule_matches_notification(r, expected))
+                                        rule_apply(r, expected);
+                        }
+                        rule_apply_all(n);
+
+                        ASSERT_EQ(expected->urgency, n->urgency);
+                        ASSERT_EQ(expected->transient, n->transient);
+                        ASSERT_EQ(expected->timeout, n->timeout);
+                        ASSERT_EQ(expected->history_ignore, n->history_ignore);
+                        ASSERT_STR_EQ(expected->icon, n->icon);
+                        ASSERT_EQ(expected->color_strings[ColFG], n->color_strings[ColFG]);
+
+                        notification_free(expected);
+                        notification_free(n);
+                }
+
+                g_slist_free_full(rules, rule_free);
+                rules = saved;
+                rules_compile();
+        }
+
+        g_rand_free(rng);
+
+        rules_cache_stats(&hits, &misses);
+        ASSERT(hits > hits_before);
+        ASSERT(misses > misses_before);
+        PASS();
+}
+
+static bool summary_matches(const char *pattern, enum match_mode mode, const char *summary)
+{
+        rule_t r;
+        rule_init(&r);
+        r.summary = (char *) pattern;
+        r.summary_match = mode;
+        r.timeout = 42;
+
+        GSList *saved = rules;
+        rules = g_slist_append(NULL, &r);
+        rules_compile();
+
+        notification *n = notification_create();
+        n->summary = g_strdup(summary);
+        n->timeout = -1;
+        rule_apply_all(n);
+        bool matched = n->timeout == 42;
+
+        notification_free(n);
+        g_slist_free(rules);
+        rules = saved;
+        rules_compile();
+
+        return matched;
+}
+
+TEST test_rule_match_modes(void)
+{
+        ASSERT(summary_matches("Hello*", MATCH_GLOB_CASELESS, "hELLO world"));
+        ASSERT_FALSE(summary_matches("Hello", MATCH_GLOB_CASELESS, "hello world"));
+        ASSERT(summary_matches("[!a]?C\\*", MATCH_GLOB_CASELESS, "bbc*"));
+        ASSERT(summary_matches("*.PNG", MATCH_GLOB_CASELESS, "a\nb.png"));
+        ASSERT(summary_matches("a[(|", MATCH_GLOB_CASELESS, "A[(|"));
+        ASSERT(summary_matches("[[:upper:]]x", MATCH_GLOB_CASELESS, "AX"));
+
+        ASSERT(summary_matches("colou?r", MATCH_REGEX, "my color"));
+        ASSERT(summary_matches("ab+c", MATCH_REGEX, "abbbc"));
+        ASSERT(summary_matches("ab{0}c", MATCH_REGEX, "ac"));
+        ASSERT(summary_matches("(foo|bar)baz", MATCH_REGEX, "barbaz"));
+        ASSERT(summary_matches("foo|bar", MATCH_REGEX, "bar"));
+        ASSERT(summary_matches("x{y|z}w", MATCH_REGEX, "z}w"));
+        ASSERT(summary_matches("[[:alpha:]]]x", MATCH_REGEX, "a]x"));
+        ASSERT(summary_matches("abc\\x41|d", MATCH_REGEX, "d"));
+        ASSERT(summary_matches("\\(?abc", MATCH_REGEX, "abc"));
+        ASSERT(summary_matches("(?i)abc", MATCH_REGEX, "ABC"));
+        ASSERT(summary_matches("\u00e9t\u00e9?", MATCH_REGEX, "\u00e9t"));
+        ASSERT_FALSE(summary_matches("abc", MATCH_REGEX, "ABC"));
+        ASSERT_FALSE(summary_matches("(", MATCH_REGEX, "("));
+
+        ASSERT(summary_matches("abc", MATCH_REGEX_CASELESS, "xABCx"));
+        ASSERT(summary_matches("disk", MATCH_REGEX_CASELESS, "DIS\u212a"));
+        ASSERT(summary_matches("\u00e9t\u00e9", MATCH_REGEX_CASELESS, "\u00c9T\u00c9"));
+        PASS();
+}
+
+TEST test_rules_compile_drops_regexes(void)
+{
+        rule_t a, b;
+        rule_init(&a);
+        rule_init(&b);
+        a.summary = "^first";
+        a.summary_match = MATCH_REGEX;
+        b.summary = "^second";
+        b.summary_match = MATCH_REGEX;
+
+        GSList *saved = rules;
+        rules = g_slist_append(NULL, &a);
+        rules_compile();
+        ASSERT_EQ(1, rules_regex_count());
+
+        /* editing a pattern must not keep the old expression around */
+        rules = g_slist_append(rules, &b);
+        rules_compile();
+        ASSERT_EQ(2, rules_regex_count());
+        rules = g_slist_remove(rules, &a);
+        rules_compile();
+        ASSERT_EQ(1, rules_regex_count());
+
+        g_slist_free(rules);
+        rules = saved;
+        rules_compile();
+        PASS();
+}
+
+SUITE(suite_rules)
+{
+        RUN_TEST(test_rule_apply_all_differential);
+        RUN_TEST(test_rule_match_modes);
+        RUN_TEST(test_rules_compile_drops_regexes);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
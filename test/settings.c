@@ -0,0 +1,82 @@
+#include "greatest.h"
+#include "src/settings.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+/* defined by config.h in src/settings.c */
+extern settings_t defaults;
+
+static char *dunstrc = NULL;
+
+static void load_dunstrc(const char *contents)
+{
+        g_file_set_contents(dunstrc, contents, -1, NULL);
+        load_settings(dunstrc);
+}
+
+TEST test_settings_icon_cache_memory(void)
+{
+        load_dunstrc("[global]\n    icon_cache_memory = 1024\n");
+        ASSERT_EQ(1024, settings.icon_cache_memory);
+
+        load_dunstrc("[global]\n    icon_cache_memory = 0\n");
+        ASSERT_EQ(0, settings.icon_cache_memory);
+
+        /* negative limits would wrap around to an unlimited cache */
+        load_dunstrc("[global]\n    icon_cache_memory = -1\n");
+        ASSERT_EQ(defaults.icon_cache_memory, settings.icon_cache_memory);
+        PASS();
+}
+
+TEST test_settings_history_memory(void)
+{
+        load_dunstrc("[global]\n    history_memory = 4096\n");
+        ASSERT_EQ(4096, settings.history_memory);
+
+        load_dunstrc("[global]\n    history_memory = -1\n");
+        ASSERT_EQ(defaults.history_memory, settings.history_memory);
+        PASS();
+}
+
+TEST test_settings_reload_shortcut(void)
+{
+        load_dunstrc("[shortcuts]\n    history = ctrl+grave\n");
+        ASSERT_STR_EQ("ctrl+grave", settings.history_ks.str);
+
+        /* as if x_shortcut_init had parsed it */
+        settings.history_ks.mask = 1 << 2;
+        settings.history_ks.code = 49;
+        settings.history_ks.is_valid = true;
+
+        /* the old modifiers must not stick to the new shortcut */
+        load_dunstrc("[shortcuts]\n    history = mod4+grave\n");
+        ASSERT_STR_EQ("mod4+grave", settings.history_ks.str);
+        ASSERT_EQ(0, settings.history_ks.mask);
+        ASSERT_EQ(0, settings.history_ks.code);
+        ASSERT_FALSE(settings.history_ks.is_valid);
+        PASS();
+}
+
+SUITE(suite_settings)
+{
+        int fd = g_file_open_tmp("dunstrc-XXXXXX", &dunstrc, NULL);
+        if (fd < 0) {
+                fprintf(stderr, "Unable to create a temporary dunstrc\n");
+                return;
+        }
+        close(fd);
+
+        RUN_TEST(test_settings_icon_cache_memory);
+        RUN_TEST(test_settings_history_memory);
+        RUN_TEST(test_settings_reload_shortcut);
+
+        g_unlink(dunstrc);
+        g_free(dunstrc);
+        dunstrc = NULL;
+
+        /* leave the settings as the other suites expect them */
+        load_settings("data/dunstrc.default");
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
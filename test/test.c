@@ -4,6 +4,15 @@ SUITE_EXTERN(suite_utils);
 SUITE_EXTERN(suite_option_parser);
 SUITE_EXTERN(suite_notification);
 SUITE_EXTERN(suite_markup);
+SUITE_EXTERN(suite_queues);
+SUITE_EXTERN(suite_rawimage);
+SUITE_EXTERN(suite_history_log);
+SUITE_EXTERN(suite_format);
+SUITE_EXTERN(suite_menu);
+SUITE_EXTERN(suite_rules);
+SUITE_EXTERN(suite_icon_cache);
+SUITE_EXTERN(suite_icon_index);
+SUITE_EXTERN(suite_settings);
 
 GREATEST_MAIN_DEFS();
 
@@ -13,6 +22,15 @@ int main(int argc, char *argv[]) {
         RUN_SUITE(suite_option_parser);
         RUN_SUITE(suite_notification);
         RUN_SUITE(suite_markup);
+        RUN_SUITE(suite_queues);
+        RUN_SUITE(suite_rawimage);
+        RUN_SUITE(suite_history_log);
+        RUN_SUITE(suite_format);
+        RUN_SUITE(suite_menu);
+        RUN_SUITE(suite_rules);
+        RUN_SUITE(suite_icon_cache);
+        RUN_SUITE(suite_icon_index);
+        RUN_SUITE(suite_settings);
         GREATEST_MAIN_END();
 }
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
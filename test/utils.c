@@ -48,6 +48,31 @@ TEST test_string_replace_all(void)
         PASS();
 }
 
+TEST test_string_replace_all_large(void)
+{
+        const int count = 100000;
+        char *text = g_strnfill(count * 3, 'x');
+        for (int i = 0; i < count; i++)
+                text[i * 3] = 'a';
+
+        text = string_replace_all("a", "<br>", text);
+        ASSERT_EQ(count * 6, strlen(text));
+        ASSERT_EQ(0, strncmp("<br>xx<br>xx", text, 12));
+        ASSERT_STR_EQ("<br>xx", text + count * 6 - 6);
+
+        char *shrunk = string_replace_all("<br>", "\n", text);
+        ASSERT_EQ(text, shrunk);
+        ASSERT_EQ(count * 3, strlen(text));
+        ASSERT_EQ(0, strncmp("\nxx\nxx", text, 6));
+
+        text = string_replace_all("xx", "", text);
+        ASSERT_EQ(count, strlen(text));
+        ASSERT_EQ(count, strspn(text, "\n"));
+
+        g_free(text);
+        PASS();
+}
+
 TEST test_string_replace(void)
 {
         char *text = malloc(128 * sizeof(char));
@@ -104,6 +129,53 @@ TEST test_string_append(void)
         PASS();
 }
 
+TEST test_string_append_large(void)
+{
+        char *text = NULL;
+        for (int i = 0; i < 10000; i++)
+                text = string_append(text, "line", "\n");
+
+        ASSERT_EQ(10000 * 5 - 1, strlen(text));
+        ASSERT_EQ(0, strncmp("line\nline\n", text, 10));
+
+        g_free(text);
+        PASS();
+}
+
+TEST test_string_builder(void)
+{
+        string_builder *b = string_builder_new(0);
+
+        string_builder_reserve(b, 1000);
+        ASSERT(b->allocated_len > 1000);
+        ASSERT_EQ(0, b->len);
+
+        string_builder_append(b, "abc", -1);
+        string_builder_append(b, "defg", 2);
+        string_builder_append_escaped(b, "<a href=\"x\">'&'</a>", -1);
+        string_builder_append_escaped(b, "&&", 1);
+        string_builder_append_printf(b, " %d", 42);
+
+        char *str = string_builder_steal(b);
+        ASSERT_STR_EQ("abcde&lt;a href=&quot;x&quot;&gt;&apos;&amp;&apos;&lt;/a&gt;&amp; 42", str);
+        g_free(str);
+
+        /* growing to a large size takes only a few reallocations */
+        b = string_builder_new(0);
+        int reallocations = 0;
+        for (int i = 0; i < 1000000; i++) {
+                gsize allocated = b->allocated_len;
+                string_builder_append(b, "x", 1);
+                if (b->allocated_len != allocated)
+                        reallocations++;
+        }
+        ASSERT_EQ(1000000, b->len);
+        ASSERT(reallocations < 32);
+        string_builder_free(b);
+
+        PASS();
+}
+
 TEST test_string_strip_delimited(void)
 {
         char *text = malloc(128 * sizeof(char));
@@ -176,8 +248,11 @@ SUITE(suite_utils)
 {
         RUN_TEST(test_string_replace_char);
         RUN_TEST(test_string_replace_all);
+        RUN_TEST(test_string_replace_all_large);
         RUN_TEST(test_string_replace);
         RUN_TEST(test_string_append);
+        RUN_TEST(test_string_append_large);
+        RUN_TEST(test_string_builder);
         RUN_TEST(test_string_strip_delimited);
         RUN_TEST(test_string_to_path);
         RUN_TEST(test_string_to_time);